@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// a signal to emit once the power button has been held for a time
+struct holdThreshold
+{
+    std::chrono::milliseconds time;
+    bool pressedLong; // emit PressedLong, else Released
+
+    bool operator==(const holdThreshold&) const = default;
+};
+
+// the settings only the power button has
+struct powerButtonConfig
+{
+    std::vector<holdThreshold> holdThresholds; // by ascending time
+
+    bool operator==(const powerButtonConfig&) const = default;
+};
+
+// the settings only the host selector has
+struct hostSelectorConfig
+{
+    // host number for each switch value in host_selector_map
+    std::vector<std::pair<size_t, size_t>> positions;
+    size_t maxPosition;
+    std::chrono::milliseconds settleTime;
+    std::chrono::milliseconds minPositionInterval;
+
+    bool operator==(const hostSelectorConfig&) const = default;
+};
+
+// the settings of a button interface besides its gpios, parsed from the
+// gpio defs by the form factor's parseConfig()
+using buttonExtraInfo =
+    std::variant<std::monostate, powerButtonConfig, hostSelectorConfig>;
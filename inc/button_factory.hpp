@@ -3,14 +3,38 @@
 #include "button_interface.hpp"
 #include "gpio.hpp"
 
+#include <nlohmann/json.hpp>
 #include <phosphor-logging/elog-errors.hpp>
 
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 using buttonIfCreatorMethod = std::function<std::unique_ptr<ButtonIface>(
     sdbusplus::bus::bus& bus, buttonConfig& buttonCfg,
     boost::asio::io_service& io)>;
 
+using buttonConfigParserMethod = std::function<void(
+    const nlohmann::json& buttonJson, buttonConfig& buttonCfg)>;
+
+// the json type a gpio defs setting must have
+enum class configValueType
+{
+    string,
+    unsignedInteger,
+    array,
+    object
+};
+
+// a setting a form factor reads from its gpio defs entry, besides the
+// name, gpio and direction keys every entry has
+struct configKey
+{
+    std::string_view name;
+    configValueType type;
+    bool required;
+};
+
 /**
  * @brief This is abstract factory for the creating phosphor buttons objects
  * based on the button  / formfactor type given.
@@ -31,6 +55,9 @@ class ButtonFactory
      * name and the value is lambda method to return
      * the instance of the button interface.
      * This key value pair is stored in the Map buttonIfaceRegistry.
+     * Button interfaces with settings of their own in the gpio defs also
+     * have their static parseConfig() stored in configParserRegistry, and
+     * the configKeys declaring those settings in configSchemaRegistry.
      */
 
     template <typename T>
@@ -42,7 +69,60 @@ class ButtonFactory
             return std::make_unique<T>(bus, T::getDbusObjectPath(), buttonCfg,
                                        io);
         };
+        if constexpr (requires(const nlohmann::json& buttonJson,
+                               buttonConfig& buttonCfg) {
+                          T::parseConfig(buttonJson, buttonCfg);
+                      })
+        {
+            configParserRegistry[std::string(T::getFormFactorName())] =
+                &T::parseConfig;
+        }
+        if constexpr (requires { T::configKeys; })
+        {
+            configSchemaRegistry[std::string(T::getFormFactorName())] =
+                std::vector<configKey>(T::configKeys.begin(),
+                                       T::configKeys.end());
+        }
+    }
+    /**
+     * @brief this method tells if a button interface is registered
+     *    for the button formfactor name provided
+     */
+    bool isSupported(const std::string& name) const
+    {
+        return buttonIfaceRegistry.contains(name);
     }
+
+    /**
+     * @brief this method returns the settings the button interface
+     *    reads from its gpio defs entry, if it has any
+     */
+    const std::vector<configKey>& getConfigKeys(const std::string& name) const
+    {
+        static const std::vector<configKey> noKeys;
+        auto schemaIter = configSchemaRegistry.find(name);
+        if (schemaIter != configSchemaRegistry.end())
+        {
+            return schemaIter->second;
+        }
+        return noKeys;
+    }
+
+    /**
+     * @brief this method reads the settings the button interface has
+     *    besides its gpios from its gpio defs entry into buttonCfg, so
+     *    that the json can be freed once the buttons are configured
+     */
+    void parseConfig(const std::string& name, const nlohmann::json& buttonJson,
+                     buttonConfig& buttonCfg) const
+    {
+        auto parserIter = configParserRegistry.find(name);
+        if (parserIter != configParserRegistry.end())
+        {
+            parserIter->second(buttonJson, buttonCfg);
+        }
+    }
+
     /**
      * @brief this method returns the button interface object
      *    corresponding to the button formfactor name provided
@@ -67,6 +147,12 @@ class ButtonFactory
   private:
     // This map is the registry for keeping supported button interface types.
     std::unordered_map<std::string, buttonIfCreatorMethod> buttonIfaceRegistry;
+    // The config parsers of the button interfaces that have one.
+    std::unordered_map<std::string, buttonConfigParserMethod>
+        configParserRegistry;
+    // The settings each button interface accepts in its gpio defs entry.
+    std::unordered_map<std::string, std::vector<configKey>>
+        configSchemaRegistry;
 };
 
 template <class T>
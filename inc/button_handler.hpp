@@ -1,7 +1,18 @@
 #pragma once
+#include "config.h"
+
+#include <boost/asio/spawn.hpp>
+#include <sdbusplus/asio/connection.hpp>
 #include <sdbusplus/bus.hpp>
 #include <sdbusplus/bus/match.hpp>
 
+#include <chrono>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
 namespace phosphor
 {
 namespace button
@@ -25,6 +36,10 @@ enum class PowerEvent
  * There are 3 buttons supported - Power, ID, and Reset.
  * As not all systems may implement each button, this class will
  * check for that button on D-Bus before listening for its signals.
+ *
+ * Every D-Bus call made while handling a button is sent asynchronously
+ * from a coroutine on the connection's io_context, so a slow peer only
+ * delays the press it is involved in and never the event loop.
  */
 class Handler
 {
@@ -39,62 +54,119 @@ class Handler
     /**
      * @brief Constructor
      *
-     * @param[in] bus - sdbusplus connection object
+     * @param[in] bus - sdbusplus asio connection object
+     * @param[in] watchButtons - listen for the button signals on D-Bus.
+     *                           Off when the buttons daemon calls the
+     *                           handler directly, see inProcessHandler.
      */
-    explicit Handler(sdbusplus::bus::bus& bus);
+    explicit Handler(sdbusplus::asio::connection& bus,
+                     bool watchButtons = true);
 
-  private:
     /**
      * @brief The handler for a power button press
      *
      * It will power on the system if it's currently off,
      * else it will soft power it off.
-     *
-     * @param[in] msg - sdbusplus message from signal
      */
-    void powerReleased(sdbusplus::message::message& msg);
+    void powerReleased();
 
     /**
      * @brief The handler for a long power button press
      *
      * If the system is currently powered on, it will
      * perform an immediate power off.
-     *
-     * @param[in] msg - sdbusplus message from signal
      */
-    void longPowerPressed(sdbusplus::message::message& msg);
+    void longPowerPressed();
 
     /**
      * @brief The handler for an ID button press
      *
      * Toggles the ID LED group
-     *
-     * @param[in] msg - sdbusplus message from signal
      */
-    void idReleased(sdbusplus::message::message& msg);
+    void idReleased();
 
     /**
      * @brief The handler for a reset button press
      *
      * Reboots the host if it is powered on.
+     */
+    void resetReleased();
+
+  private:
+    /**
+     * @brief Looks up the buttons present on D-Bus and registers
+     *        the signal handlers for them.
      *
-     * @param[in] msg - sdbusplus message from signal
+     * @param[in] yield - the coroutine context to suspend on
      */
-    void resetReleased(sdbusplus::message::message& msg);
+    void registerButtons(boost::asio::yield_context yield);
+
+    /**
+     * @brief Sends a method call and suspends the calling coroutine
+     *        until the reply arrives or DBUS_CALL_TIMEOUT_MS expires.
+     *
+     * @param[in] method - the method call to send
+     * @param[in] yield - the coroutine context to suspend on
+     *
+     * @return the method reply; throws sdbusplus::exception on error
+     */
+    sdbusplus::message::message call(sdbusplus::message::message& method,
+                                     boost::asio::yield_context yield) const;
 
     /**
      * @brief Checks if system is powered on
      *
      * @return true if powered on, false else
      */
-    bool poweredOn(size_t hostNumber) const;
+    bool poweredOn(size_t hostNumber, boost::asio::yield_context yield) const;
 
-    /*
+    /**
+     * @brief Looks up the service hosting an object, answering from
+     *        serviceCache when possible and asking the mapper otherwise.
+     *
      * @return std::string - the D-Bus service name if found, else
      *                       an empty string
      */
     std::string getService(const std::string& path,
-                           const std::string& interface) const;
+                           const std::string& interface,
+                           boost::asio::yield_context yield) const;
+
+    /**
+     * @brief The handler for NameOwnerChanged
+     *
+     * Drops cached service names owned by a name that changed owner,
+     * and forgets negative lookups once a new service shows up.
+     *
+     * @param[in] msg - sdbusplus message from signal
+     */
+    void nameOwnerChanged(sdbusplus::message::message& msg);
+
+    /**
+     * @brief The handler for InterfacesAdded and InterfacesRemoved
+     *
+     * Drops cached service names for the object path in the signal.
+     *
+     * @param[in] msg - sdbusplus message from signal
+     */
+    void interfacesChanged(sdbusplus::message::message& msg);
+
+    /**
+     * @brief The handler for PropertiesChanged on the chassis state objects
+     *
+     * Keeps poweredOnMirror up to date with CurrentPowerState.
+     *
+     * @param[in] msg - sdbusplus message from signal
+     */
+    void chassisPropertiesChanged(sdbusplus::message::message& msg);
+
+    /**
+     * @brief The handler for PropertiesChanged on the host selector object
+     *
+     * Keeps hostSelectorMirror up to date with Position.
+     *
+     * @param[in] msg - sdbusplus message from signal
+     */
+    void hostSelectorPropertiesChanged(sdbusplus::message::message& msg);
 
     /**
      * @brief gets the valid host selector value in multi host
@@ -104,7 +176,7 @@ class Handler
      * invalid or not available.
      */
 
-    size_t getHostSelectorValue();
+    size_t getHostSelectorValue(boost::asio::yield_context yield);
 
     /**
      * @brief checks if the system has multi host
@@ -113,19 +185,95 @@ class Handler
      * @return bool returns true if multi host system
      * else returns false.
      */
-    bool isMultiHost();
+    bool isMultiHost(boost::asio::yield_context yield);
     /**
      * @brief trigger the power ctrl event based on the
-     *  button press event type.
+     *  button press event type. The time from received to the transition
+     *  being set is recorded, if one is set.
      *
      * @return void
      */
-    void handlePowerEvent(PowerEvent powerEventType);
+    void handlePowerEvent(PowerEvent powerEventType,
+                          std::chrono::steady_clock::time_point received,
+                          boost::asio::yield_context yield);
 
     /**
-     * @brief sdbusplus connection object
+     * @brief Toggles the ID LED group, recording the time from received
+     *  to the LED group being set
+     *
+     * @return void
+     */
+    void toggleIdLed(std::chrono::steady_clock::time_point received,
+                     boost::asio::yield_context yield);
+
+    /**
+     * @brief sdbusplus asio connection object
+     */
+    sdbusplus::asio::connection& bus;
+
+    /**
+     * @brief Service names keyed by (object path, interface). An empty
+     * name records that the mapper reported the object as not present.
+     */
+    mutable std::map<std::pair<std::string, std::string>, std::string>
+        serviceCache;
+
+    /**
+     * @brief Number of getService() calls answered from serviceCache
+     */
+    mutable uint64_t serviceCacheHits = 0;
+
+    /**
+     * @brief Number of getService() calls that went to the mapper
+     */
+    mutable uint64_t serviceCacheMisses = 0;
+
+    /**
+     * @brief A property value mirrored from D-Bus, along with the unique
+     * name of the connection that owns it. The value is only trusted while
+     * that connection stays on the bus.
+     */
+    template <typename T>
+    struct Mirror
+    {
+        std::string owner;
+        T value;
+    };
+
+    /**
+     * @brief Whether each chassisN object is powered on, keyed by N
+     */
+    mutable std::map<size_t, Mirror<bool>> poweredOnMirror;
+
+    /**
+     * @brief The host selector Position
      */
-    sdbusplus::bus::bus& bus;
+    std::optional<Mirror<size_t>> hostSelectorMirror;
+
+    /**
+     * @brief Matches on PropertiesChanged for the chassis state objects
+     */
+    std::unique_ptr<sdbusplus::bus::match_t> chassisPropertiesChangedMatch;
+
+    /**
+     * @brief Matches on PropertiesChanged for the host selector object
+     */
+    std::unique_ptr<sdbusplus::bus::match_t> hostSelectorPropertiesChangedMatch;
+
+    /**
+     * @brief Matches on NameOwnerChanged to invalidate serviceCache
+     */
+    std::unique_ptr<sdbusplus::bus::match_t> nameOwnerChangedMatch;
+
+    /**
+     * @brief Matches on InterfacesAdded to invalidate serviceCache
+     */
+    std::unique_ptr<sdbusplus::bus::match_t> interfacesAddedMatch;
+
+    /**
+     * @brief Matches on InterfacesRemoved to invalidate serviceCache
+     */
+    std::unique_ptr<sdbusplus::bus::match_t> interfacesRemovedMatch;
 
     /**
      * @brief Matches on the power button released signal
@@ -148,5 +296,29 @@ class Handler
     std::unique_ptr<sdbusplus::bus::match_t> resetButtonReleased;
 };
 
+/**
+ * @brief The handler built into the buttons daemon with the fused-handler
+ * option. The buttons call it directly as well as sending their signals.
+ * nullptr when button-handler runs as its own service.
+ */
+extern Handler* inProcessHandler;
+
+#ifdef FUSED_HANDLER
+/**
+ * @brief Passes a button signal that was just sent on to inProcessHandler.
+ * Only built with the handler in this process, so its callers have to be
+ * under FUSED_HANDLER as well.
+ *
+ * @param[in] action - the Handler method for the signal
+ */
+inline void notifyInProcessHandler(void (Handler::*action)())
+{
+    if (inProcessHandler != nullptr)
+    {
+        (inProcessHandler->*action)();
+    }
+}
+#endif
+
 } // namespace button
 } // namespace phosphor
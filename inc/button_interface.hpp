@@ -15,21 +15,28 @@ class ButtonIface
   public:
     ButtonIface(sdbusplus::bus::bus& bus, buttonConfig& buttonCfg,
                 boost::asio::io_service& io,
-                const std::function<void(void*, bool, std::string)> handler =
+                const std::function<void(void*, const gpioEvent&)> handler =
                     ButtonIface::EventHandler) :
         bus(bus),
         config(buttonCfg), callbackHandler(handler)
     {
         int ret = -1;
 
-        // Create a new stream descriptor for each gpio
-        // Also give each gpio a callback handler and userdata pointer
-        for (auto& config : config.gpios)
+        // Give each gpio a callback handler, userdata pointer and its
+        // index for the events, and a debounce timer if the kernel doesn't
+        // debounce it
+        for (size_t index = 0; index < config.gpios.size(); index++)
         {
-            config.streamDesc =
-                std::make_shared<boost::asio::posix::stream_descriptor>(io);
-            config.handler = callbackHandler;
-            config.userdata = (void*)this;
+            auto& gpioCfg = config.gpios[index];
+            if (gpioCfg.debounceTime.count() > 0 && !gpioCfg.kernelDebounce)
+            {
+                gpioCfg.debounceTimer =
+                    std::make_shared<boost::asio::steady_timer>(io);
+            }
+            gpioCfg.index = index;
+            gpioCfg.handler = callbackHandler;
+            gpioCfg.resyncHandler = ButtonIface::ResyncHandler;
+            gpioCfg.userdata = (void*)this;
         }
         // config group gpio based on the gpio defs read from the json file
         ret = configGroupGpio(config);
@@ -49,26 +56,48 @@ class ButtonIface
      * callbackHandler if platform specific event handling is needed then a
      * derived class instance with its specific evend handling logic along with
      * init() function can be created to override the default event handling.
+     * It runs for every edge, so it shouldn't allocate or format strings
+     * unless it is going to use them.
      */
 
-    virtual void handleEvent(bool asserted, std::string gpio_name) = 0;
-    static int EventHandler(void* userdata, bool asserted,
-                            std::string gpio_name)
+    virtual void handleEvent(const gpioEvent& event) = 0;
+    static int EventHandler(void* userdata, const gpioEvent& event)
     {
         if (userdata)
         {
             ButtonIface* buttonIface = static_cast<ButtonIface*>(userdata);
-            buttonIface->handleEvent(asserted, gpio_name);
+            buttonIface->handleEvent(event);
         }
 
         return 0;
     }
 
-    std::string getFormFactorType() const
+    /**
+     * @brief called once the button's gpios are back in service after a
+     * fault, after an edge has been passed to handleEvent() for each of
+     * them that changed state meanwhile. A button that reads its gpios
+     * rather than following their edges can read them again here.
+     */
+
+    virtual void resync() {}
+    static void ResyncHandler(void* userdata)
+    {
+        if (userdata)
+        {
+            static_cast<ButtonIface*>(userdata)->resync();
+        }
+    }
+
+    const std::string& getFormFactorType() const
     {
         return config.formFactorName;
     }
 
+    const buttonConfig& getConfig() const
+    {
+        return config;
+    }
+
   protected:
     /**
      * @brief oem specific initialization can be done under init function.
@@ -89,11 +118,11 @@ class ButtonIface
     {
         for (auto& gpioCfg : config.gpios)
         {
-            ::closeGpio(gpioCfg.button_name);
+            ::closeGpio(gpioCfg);
         }
     }
 
     sdbusplus::bus::bus& bus;
     buttonConfig config;
-    const std::function<void(void*, bool, std::string)> callbackHandler;
+    const std::function<void(void*, const gpioEvent&)> callbackHandler;
 };
@@ -15,58 +15,95 @@
 */
 #pragma once
 
+#include "button_config.hpp"
+#include "gpio_backend.hpp"
+
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <gpiod.hpp>
-#include <nlohmann/json.hpp>
 #include <sdbusplus/bus.hpp>
 
+#include <chrono>
+#include <cstdint>
 #include <string>
 #include <vector>
 
+class GpioRegistry;
+
+// identifies a requested line in the GpioRegistry
+using gpioHandle = uint32_t;
+constexpr gpioHandle noGpioHandle = UINT32_MAX;
+
+// an edge on a button gpio, as passed to the button's handler
+struct gpioEvent
+{
+    size_t index;            // position of the gpio in buttonConfig::gpios
+    bool asserted;           // true for an edge in the configured direction
+    gpioEventTime timestamp; // when the kernel saw the edge
+};
+
+// this struct has the event counters for single gpio
+struct gpioEventStats
+{
+    uint64_t events = 0;     // edge events read for the line
+    uint64_t overflows = 0;  // times the kernel dropped events for the line
+    uint64_t dropped = 0;    // edge events the kernel dropped for the line
+    uint64_t debounced = 0;  // edges filtered out by the software debouncer
+    uint64_t faults = 0;     // times the line's chip request failed
+    uint64_t recoveries = 0; // times the line was requested again after that
+};
+
 // this struct has the gpio config for single gpio
 struct gpioInfo
 {
     std::string button_name;
     std::string gpio_name;
-    int direction;
-    gpiod::line line;
-    std::shared_ptr<boost::asio::posix::stream_descriptor> streamDesc;
+    gpiod::edge_event::event_type direction;
+    std::string chip;    // gpiochip device the line was found on
+    unsigned int offset; // offset of the line on that chip
+    size_t index;        // position of the gpio in its button's config
+    gpioHandle handle;   // the line in the registry that requested it
+    GpioRegistry* registry;
     void* userdata;
-    std::function<void(void*, bool, std::string)> handler;
+    std::function<void(void*, const gpioEvent&)> handler;
+    // called once the line is back in service after a fault
+    std::function<void(void*)> resyncHandler;
+    gpioEventStats stats;
+    unsigned long lastSeqno; // kernel sequence number of the last event
+
+    // an edge is only passed on once the line has stayed in the new state
+    // for debounceTime. The kernel does this when it supports it, else a
+    // timer on the event loop does.
+    std::chrono::milliseconds debounceTime;
+    bool kernelDebounce;
+    std::shared_ptr<boost::asio::steady_timer> debounceTimer;
+    bool reportedAsserted; // the state last passed to the handler
+    bool pendingAsserted;
+    gpioEventTime pendingTime;
 
     gpioInfo(const std::string button_name, const std::string gpio_name,
-             const std::string direction) :
+             const std::string direction, unsigned int debounce_ms = 0) :
         button_name(button_name),
-        gpio_name(gpio_name), streamDesc(nullptr), userdata(nullptr),
-        handler(nullptr)
+        gpio_name(gpio_name), offset(0), index(0), handle(noGpioHandle),
+        registry(nullptr), userdata(nullptr),
+        handler(nullptr), resyncHandler(nullptr),
+        lastSeqno(0), debounceTime(debounce_ms), kernelDebounce(false),
+        debounceTimer(nullptr), reportedAsserted(false),
+        pendingAsserted(false)
     {
         setDirection(direction);
     }
 
-    gpioInfo(const gpioInfo& src) :
-        button_name(src.button_name), gpio_name(src.gpio_name),
-        direction(src.direction), line(src.line), streamDesc(src.streamDesc),
-        userdata(src.userdata), handler(src.handler)
-    {}
-
-    ~gpioInfo()
-    {
-        if (streamDesc.get() != NULL)
-        {
-            streamDesc.reset();
-        }
-    }
-
     void setDirection(std::string dirStr)
     {
         // Determine edge type. Default is falling edge means asserted.
-        auto dir = gpiod::line_event::FALLING_EDGE;
+        auto dir = gpiod::edge_event::event_type::FALLING_EDGE;
         std::for_each(dirStr.begin(), dirStr.end(),
                       [](char& c) { c = ::tolower(c); });
         if (dirStr == "rising")
         {
-            dir = gpiod::line_event::RISING_EDGE;
+            dir = gpiod::edge_event::event_type::RISING_EDGE;
         }
         this->direction = dir;
     }
@@ -75,29 +112,87 @@ struct gpioInfo
 // this struct represents button interface
 struct buttonConfig
 {
-    std::string formFactorName;   // name of the button interface
-    std::vector<gpioInfo> gpios;  // holds single or group gpio config
-    nlohmann::json extraJsonInfo; // corresponding to button interface
+    std::string formFactorName;  // name of the button interface
+    std::vector<gpioInfo> gpios; // holds single or group gpio config
+    buttonExtraInfo extraInfo; // the form factor's own settings
 };
 
+/**
+ * @brief finds the chip and offset of every gpio of the given button configs
+ * that isn't resolved yet, with one scan of the gpiochips
+ */
+
+void resolveGpios(std::vector<buttonConfig>& buttonConfigs);
+
+/**
+ * @brief tells if two button configs come from the same gpio defs entry,
+ * ignoring what has been resolved or bound since
+ */
+
+bool isSameButtonConfig(const buttonConfig& a, const buttonConfig& b);
+
 /**
  * @brief iterates over the list of gpios and configures gpios them
  * config which is set from gpio defs json file.
- * The fd of the configured gpio is stored in buttonConfig.gpios container
+ * Events for the gpios are then passed to their handler.
  * @return int returns 0 on successful config of all gpios
  */
 
 int configGroupGpio(buttonConfig& buttonIFConfig);
 
 /**
- * @brief  configures and initializes the single gpio
+ * @brief  configures and initializes the single gpio, which must have been
+ * requested by a GpioRegistry
  * @return int returns 0 on successful config of all gpios
  */
 
 int configGpio(gpioInfo& gpioConfig);
 
+/**
+ * @brief reads the current level of a requested gpio
+ * @return int returns 1 if the line is high, 0 if it is low
+ */
+
+int getGpioValue(const gpioInfo& gpioConfig);
+
+/**
+ * @brief reads the current levels of a set of requested gpios, with one
+ * read for all the lines on each gpiochip
+ * @return std::vector<int> returns 1 for each line that is high, else 0
+ */
+
+std::vector<int> getGpioValues(const std::vector<gpioInfo>& gpios);
+
+/**
+ * @brief reads the gpiochips through the character devices again, picking
+ * up any probed since the last scan. resolveGpios() does this itself.
+ */
+
+void rescanGpioChips();
+
+/**
+ * @brief lists the gpiochips in path order, as of the last scan. They are
+ * scanned the first time this is called if they haven't been yet.
+ */
+
+const std::vector<gpioChipInfo>& getGpioChips();
+
+/**
+ * @brief finds the gpiochip with the given label
+ * @return the chip, or nullptr if there is none
+ */
+
+const gpioChipInfo* getGpioChipByLabel(const std::string& label);
+
+/**
+ * @brief converts an aspeed gpio pin name such as "A3" to its offset on
+ * the GPIO_BASE_LABEL_NAME gpiochip
+ */
+
 uint32_t getGpioNum(const std::string& gpioPin);
-void closeAllGpio();
-void closeGpio(const std::string& buttonName);
-// global json object which holds gpio_defs.json configs
-extern nlohmann::json gpioDefs;
+
+/**
+ * @brief stops passing the events of a gpio to its button
+ */
+
+void closeGpio(const gpioInfo& gpioConfig);
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// time of a gpio edge, as stamped by the kernel on CLOCK_MONOTONIC
+using gpioEventTime = std::chrono::steady_clock::time_point;
+
+// the most edges GpioLineRequest::readEdges() returns at once
+constexpr size_t maxEdgesPerRead = 64;
+
+// this struct has what the kernel reports about one gpiochip
+struct gpioChipInfo
+{
+    std::string path;  // character device, e.g. /dev/gpiochip0
+    std::string name;  // kernel name, e.g. gpiochip0
+    std::string label; // controller label, e.g. 1e780000.gpio
+    size_t numLines;
+};
+
+// a line to request as an input with edge events on both edges
+struct gpioLineSettings
+{
+    unsigned int offset;
+    // debounce period for the kernel to apply, or 0 for none
+    std::chrono::milliseconds debounceTime;
+};
+
+// an edge read from a line request
+struct gpioEdge
+{
+    unsigned int offset;     // offset of the line on its chip
+    bool rising;             // true for a rising edge, else falling
+    unsigned long seqno;     // per line sequence number, from 1
+    gpioEventTime timestamp; // when the kernel saw the edge
+};
+
+/**
+ * @class GpioLineRequest
+ *
+ * The lines of one gpiochip requested together. They are released when it
+ * is destroyed. Edges are read from it once fd() is readable. Every call
+ * may throw on a failure of the chip.
+ */
+class GpioLineRequest
+{
+  public:
+    virtual ~GpioLineRequest() = default;
+
+    /**
+     * @brief the fd that is readable while edges are queued. It belongs to
+     * the request, which closes it.
+     */
+    virtual int fd() const = 0;
+
+    virtual size_t numLines() const = 0;
+
+    /**
+     * @brief replaces the contents of edges with the queued edges, oldest
+     * first and at most maxEdgesPerRead. Blocks if none are queued.
+     * @return size_t returns the number of edges read
+     */
+    virtual size_t readEdges(std::vector<gpioEdge>& edges) = 0;
+
+    /**
+     * @brief waits up to the given time for an edge to be queued
+     * @return bool returns true if one is
+     */
+    virtual bool waitEdges(std::chrono::nanoseconds timeout) = 0;
+
+    /**
+     * @brief reads the level of a requested line
+     * @return int returns 1 if the line is high, 0 if it is low
+     */
+    virtual int getValue(unsigned int offset) = 0;
+
+    /**
+     * @brief reads the levels of a set of requested lines together
+     * @return std::vector<int> returns 1 for each line that is high, else 0
+     */
+    virtual std::vector<int>
+        getValues(const std::vector<unsigned int>& offsets) = 0;
+};
+
+/**
+ * @class GpioChip
+ *
+ * An open gpiochip. It can be closed once its lines have been requested,
+ * as the request doesn't need it.
+ */
+class GpioChip
+{
+  public:
+    virtual ~GpioChip() = default;
+
+    virtual gpioChipInfo getInfo() = 0;
+
+    /**
+     * @brief reads the name of a line, which is empty if it has none
+     */
+    virtual std::string getLineName(unsigned int offset) = 0;
+
+    /**
+     * @brief requests the given lines for the buttons. Throws if any of
+     * them can't be had, e.g. when the kernel doesn't support a debounce
+     * period or another consumer has the line.
+     */
+    virtual std::unique_ptr<GpioLineRequest>
+        requestLines(const std::vector<gpioLineSettings>& lines) = 0;
+};
+
+/**
+ * @class GpioBackend
+ *
+ * Where the gpio code finds, reads and requests gpiochips. It is libgpiod
+ * on the character devices, unless another backend has been set, e.g. a
+ * fake for the tests.
+ */
+class GpioBackend
+{
+  public:
+    virtual ~GpioBackend() = default;
+
+    /**
+     * @brief lists the paths of the gpiochips there are now
+     */
+    virtual std::vector<std::string> listChips() = 0;
+
+    /**
+     * @brief opens a gpiochip, throwing if it can't be
+     */
+    virtual std::unique_ptr<GpioChip> openChip(const std::string& path) = 0;
+};
+
+/**
+ * @brief the backend the gpio code uses
+ */
+
+GpioBackend& getGpioBackend();
+
+/**
+ * @brief makes the gpio code use the given backend, which must outlive its
+ * use, or libgpiod again for nullptr. Lines already requested keep the
+ * backend they were requested with, and the chips are scanned again on the
+ * next lookup by resolveGpios().
+ */
+
+void setGpioBackend(GpioBackend* backend);
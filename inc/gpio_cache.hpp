@@ -0,0 +1,29 @@
+#pragma once
+
+#include "gpio.hpp"
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief loads the button configs saved by saveGpioDefsCache(), with every
+ * gpio already resolved to its chip and offset. The cache is only used if
+ * the gpio defs file has the same size, mtime and contents hash it was
+ * saved from, each gpiochip still has the same label, and each line is
+ * still at the same offset.
+ * @return bool returns true if buttonConfigs was filled from the cache
+ */
+
+bool loadGpioDefsCache(const std::string& cachePath,
+                       const std::string& gpioDefsPath,
+                       std::vector<buttonConfig>& buttonConfigs);
+
+/**
+ * @brief saves the button configs, whose gpios have been resolved by
+ * GpioRegistry::requestGpios(), so the next start can skip parsing the gpio
+ * defs file and scanning the gpiochips for line names
+ */
+
+void saveGpioDefsCache(const std::string& cachePath,
+                       const std::string& gpioDefsPath,
+                       const std::vector<buttonConfig>& buttonConfigs);
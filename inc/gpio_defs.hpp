@@ -0,0 +1,19 @@
+#pragma once
+
+#include "gpio.hpp"
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief reads the button configs of the supported form factors from a
+ * gpio defs json file. The file is streamed through a SAX parser that
+ * builds the configs directly, and the entries of unsupported form factors
+ * are skipped over. An entry that doesn't match the keys its form factor
+ * declares is logged with the file, line and key, and left out.
+ * @return int returns the number of entries left out for errors, or -1 if
+ * the file couldn't be read or isn't valid json
+ */
+
+int loadGpioDefs(const std::string& gpioDefsPath,
+                 std::vector<buttonConfig>& buttonConfigs);
@@ -0,0 +1,193 @@
+#pragma once
+
+#include "gpio.hpp"
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <sdbusplus/asio/object_server.hpp>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+constexpr auto gpioRegistryObjectPath =
+    "/xyz/openbmc_project/Chassis/Buttons/Gpios";
+
+/**
+ * @class GpioRegistry
+ *
+ * Owns the kernel line requests of the button gpios. All the lines on one
+ * gpiochip share a single request, so each chip costs one fd and one event
+ * loop registration however many buttons it has. Every requested line gets
+ * a handle, stored in its gpioInfo, which stays the same for as long as the
+ * line is requested. Lines are found by handle, or by chip and offset,
+ * without a search.
+ *
+ * A chip whose request fails is taken out of service on its own and
+ * requested again on a timer, backing off exponentially, while the other
+ * chips carry on. Its lines stay bound to their buttons meanwhile, and the
+ * buttons get an edge for any line that changed state when it is back.
+ */
+class GpioRegistry
+{
+  public:
+    using handle = gpioHandle;
+    static constexpr handle noHandle = noGpioHandle;
+
+    explicit GpioRegistry(boost::asio::io_service& io) : io(io) {}
+    ~GpioRegistry()
+    {
+        releaseAll();
+    }
+    GpioRegistry(const GpioRegistry&) = delete;
+    GpioRegistry& operator=(const GpioRegistry&) = delete;
+
+    /**
+     * @brief requests every gpio of the given button configs from the
+     * kernel. Events are delivered once bind() ties a line to its button.
+     * @return int returns 0 when every gpio was requested
+     */
+    int requestGpios(std::vector<buttonConfig>& buttonConfigs);
+
+    /**
+     * @brief requests the gpios of buttons added by a reload of the gpio
+     * defs. Only the gpiochips that have lines being added, or lines no
+     * button uses any more, are released and requested again, and the
+     * lines on them still bound to a button keep their handles. The other
+     * chips keep their requests and fds, so their buttons don't miss any
+     * events.
+     * @return int returns 0 when every gpio was requested
+     */
+    int reloadGpios(std::vector<buttonConfig>& buttonConfigs);
+
+    /**
+     * @brief gives back the lines requested for buttons that couldn't be
+     * created, whether or not some of them were bound before it failed.
+     * Their gpiochips are requested again without them, so other
+     * consumers can have them.
+     */
+    void releaseGpios(const std::vector<buttonConfig>& buttonConfigs);
+
+    /**
+     * @brief passes the events of a requested line to the given gpio
+     * config from now on
+     * @return int returns 0 on success
+     */
+    int bind(gpioInfo& gpioConfig);
+
+    /**
+     * @brief stops passing events to the gpio config. A chip's request is
+     * released once none of its lines are bound.
+     */
+    void unbind(const gpioInfo& gpioConfig);
+
+    /**
+     * @brief reads the current level of a requested gpio
+     * @return int returns 1 if the line is high, 0 if it is low
+     */
+    int getValue(const gpioInfo& gpioConfig) const;
+
+    /**
+     * @brief reads the current levels of a set of requested gpios, with one
+     * read for all the lines on each gpiochip
+     * @return std::vector<int> returns 1 for each line that is high, else 0
+     */
+    std::vector<int> getValues(const std::vector<gpioInfo>& gpios) const;
+
+    /**
+     * @brief releases every request, and with it every handle
+     */
+    void releaseAll();
+
+    /**
+     * @brief tells if any chip is out of service, waiting for a retry
+     */
+    bool isDegraded() const
+    {
+        return degraded;
+    }
+
+    /**
+     * @brief finds the gpio config bound to a line
+     * @return the gpio config, or nullptr if the line isn't bound
+     */
+    gpioInfo* find(handle lineHandle) const;
+    gpioInfo* find(const std::string& chipPath, unsigned int offset) const;
+
+    /**
+     * @brief puts the requested lines on D-Bus at the given path, with the
+     * chip, offset and fd of each and the event and fault counters of its
+     * gpio, and whether the registry is degraded
+     *
+     * @return the interface, which stays on D-Bus while it is held
+     */
+    std::shared_ptr<sdbusplus::asio::dbus_interface>
+        addDebugInterface(sdbusplus::asio::object_server& server,
+                          const std::string& path);
+
+  private:
+    // one kernel line request covering every button gpio on a gpiochip.
+    // The handlers queued for it only hold a weak_ptr, as the chip can be
+    // released while one of them is waiting to run.
+    struct chipRequest : std::enable_shared_from_this<chipRequest>
+    {
+        std::string path;
+        // the request, or nullptr while the chip is out of service
+        std::unique_ptr<GpioLineRequest> request;
+        std::shared_ptr<boost::asio::posix::stream_descriptor> streamDesc;
+        std::vector<gpioEdge> eventBuffer;
+        // the handle of each requested offset, noHandle for the others
+        std::vector<handle> handles;
+        size_t boundLines = 0;         // lines with a gpio config bound
+        uint64_t wakeups = 0;          // times the request fd became readable
+        size_t maxEventsPerWakeup = 0; // largest batch drained in one wakeup
+        uint64_t faults = 0;           // times the request failed
+        uint64_t recoveries = 0;       // times a retry requested it again
+        std::unique_ptr<boost::asio::steady_timer> retryTimer;
+        // the wait before the next retry, or 0 once the chip has been in
+        // service long enough to start over
+        std::chrono::milliseconds retryDelay{0};
+
+        explicit chipRequest(const std::string& path) : path(path)
+        {
+            eventBuffer.reserve(maxEdgesPerRead);
+        }
+    };
+
+    // a requested line, and the gpio config bound to it if there is one
+    struct lineEntry
+    {
+        chipRequest* chip = nullptr; // nullptr while the handle is free
+        unsigned int offset = 0;
+        gpioInfo* gpio = nullptr;
+    };
+
+    bool requestChip(const std::string& chipPath,
+                     std::vector<gpioInfo*>& gpios);
+    bool openChip(chipRequest& chip, std::vector<gpioInfo*>& gpios);
+    void releaseRequest(chipRequest& chip);
+    void releaseChip(chipRequest& chip);
+    void faultChip(chipRequest& chip);
+    void scheduleRetry(chipRequest& chip);
+    void retryChip(chipRequest& chip);
+    void scheduleRetryReset(chipRequest& chip);
+    void updateDegraded();
+    handle addLine(chipRequest& chip, unsigned int offset);
+    void freeLine(handle lineHandle);
+    bool isAsserted(const gpioInfo& gpioConfig) const;
+    void resetLineState(gpioInfo& gpioConfig) const;
+    void resyncLines(const std::vector<gpioInfo*>& gpios);
+    void waitForEvent(chipRequest& chip);
+
+    boost::asio::io_service& io;
+    // lines by handle, with the freed handles reused first
+    std::vector<lineEntry> lines;
+    std::vector<handle> freeHandles;
+    // requests by gpiochip device path
+    std::unordered_map<std::string, std::shared_ptr<chipRequest>> chips;
+    bool degraded = false; // some chip is out of service
+    std::weak_ptr<sdbusplus::asio::dbus_interface> debugIface;
+};
@@ -1,6 +1,7 @@
 #pragma once
 #include "config.h"
 
+#include "button_config.hpp"
 #include "button_factory.hpp"
 #include "button_interface.hpp"
 #include "common.hpp"
@@ -10,22 +11,20 @@
 
 #include <unistd.h>
 
+#include <boost/asio/steady_timer.hpp>
 #include <nlohmann/json.hpp>
 #include <phosphor-logging/elog-errors.hpp>
 
+#include <array>
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <optional>
 
 static constexpr std::string_view HOST_SELECTOR = "HOST_SELECTOR";
 
 static constexpr auto INVALID_INDEX = std::numeric_limits<size_t>::max();
 
-enum class GpioState
-{
-    low,
-    high
-};
-
 class HostSelector final :
     public sdbusplus::server::object_t<
         sdbusplus::xyz::openbmc_project::Chassis::Buttons::server::
@@ -38,14 +37,19 @@ class HostSelector final :
         sdbusplus::server::object_t<sdbusplus::xyz::openbmc_project::Chassis::
                                         Buttons::server::HostSelector>(
             bus, path, action::defer_emit),
-        ButtonIface(bus, buttonCfg, io)
+        ButtonIface(bus, buttonCfg, io),
+        settleTime(std::get<hostSelectorConfig>(config.extraInfo).settleTime),
+        settleTimer(io),
+        minPositionInterval(std::get<hostSelectorConfig>(config.extraInfo)
+                                .minPositionInterval),
+        positionTimer(io)
     {
         init();
-        // read and store the host selector position Map
-        hsPosMap = buttonCfg.extraJsonInfo.at("host_selector_map")
-                       .get<std::map<std::string, int>>();
-        maxPosition(buttonCfg.extraJsonInfo["max_position"], true);
-        gpioLineCount = buttonCfg.gpios.size();
+        const auto& settings = std::get<hostSelectorConfig>(config.extraInfo);
+        maxPosition(settings.maxPosition, true);
+        gpioLineCount = config.gpios.size();
+        // read the host selector position map into a lookup table
+        setPositionTable(settings.positions);
         setInitialHostSelectorValue();
         emit_object_added();
     }
@@ -64,17 +68,48 @@ class HostSelector final :
     {
         return HS_DBUS_OBJECT_NAME;
     }
-    void handleEvent(bool asserted, std::string gpio_name) override;
+    void handleEvent(const gpioEvent& event) override;
+    void resync() override;
     size_t getMappedHSConfig(size_t hsPosition);
-    size_t getGpioIndex(std::string gpio_name);
+    static constexpr std::array<configKey, 4> configKeys = {
+        {{"host_selector_map", configValueType::object, true},
+         {"max_position", configValueType::unsignedInteger, true},
+         {"settle_ms", configValueType::unsignedInteger, false},
+         {"min_position_interval_ms", configValueType::unsignedInteger,
+          false}}};
+    static void parseConfig(const nlohmann::json& buttonJson,
+                            buttonConfig& buttonCfg);
+    void setPositionTable(
+        const std::vector<std::pair<size_t, size_t>>& positions);
     void setInitialHostSelectorValue(void);
-    void setHostSelectorValue(std::string gpio_name, GpioState state);
+    void readHostSelectorValue(void);
+    void setSettledHostSelectorValue(void);
+    void publishPosition(size_t hsPosMapped);
+    void emitPendingPosition(void);
 
   protected:
     size_t hostSelectorPosition = 0;
     size_t gpioLineCount;
 
-    // map of read Host selector switch value and corresponding host number
-    // value.
-    std::map<std::string, int> hsPosMap;
+    // The switch is only read once its gpios have had no edges for
+    // settleTime, so turning it doesn't publish the positions in between
+    std::chrono::milliseconds settleTime;
+    boost::asio::steady_timer settleTimer;
+    // switch values that were never published because another edge came
+    // within settleTime
+    uint64_t suppressedStates = 0;
+
+    // Position is only sent when it changes, and at most once per
+    // minPositionInterval. A position that comes sooner is held back and
+    // replaced by any later one, so only the latest is sent.
+    std::chrono::milliseconds minPositionInterval;
+    boost::asio::steady_timer positionTimer;
+    std::chrono::steady_clock::time_point lastPositionTime;
+    std::optional<size_t> pendingPosition;
+    uint64_t emittedPositions = 0;    // Position changes signalled
+    uint64_t suppressedPositions = 0; // unchanged or replaced positions
+
+    // host number for each host selector switch value, indexed by the
+    // value read from the gpios. INVALID_INDEX where there is none.
+    std::vector<size_t> hsPosTable;
 };
@@ -18,6 +18,7 @@
 #include "config.h"
 
 #include "button_factory.hpp"
+#include "button_handler.hpp"
 #include "button_interface.hpp"
 #include "common.hpp"
 #include "gpio.hpp"
@@ -54,7 +55,7 @@ class IDButton :
 
     void simPress() override;
 
-    void handleEvent(bool asserted, std::string /* gpio_name */) override;
+    void handleEvent(const gpioEvent& event) override;
 
     static constexpr std::string_view getFormFactorName()
     {
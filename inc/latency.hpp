@@ -0,0 +1,121 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <sdbusplus/asio/object_server.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace phosphor
+{
+namespace button
+{
+namespace latency
+{
+
+constexpr auto latencyObjectPath =
+    "/xyz/openbmc_project/Chassis/Buttons/Latency";
+
+/**
+ * @brief The steps a button press goes through between the gpio edge
+ * and the host transition request. The first two are measured by the
+ * buttons daemon and the others by button-handler.
+ */
+enum class Stage
+{
+    edgeToDispatch,     // kernel edge timestamp to the button handleEvent
+    dispatchToSignal,   // handleEvent to its D-Bus signal being sent
+    signalToTransition, // power/reset signal received to transition Set done
+    signalToLed,        // ID signal received to the LED group Set done
+    count
+};
+
+/**
+ * @brief Gets the name a stage is reported under
+ */
+std::string_view getStageName(Stage stage);
+
+/**
+ * @class Histogram
+ *
+ * Counts durations in buckets of doubling width: bucket 0 holds
+ * durations under 1 us and bucket N those from 2^(N-1) us up to 2^N us.
+ * The last bucket also holds everything longer.
+ */
+class Histogram
+{
+  public:
+    static constexpr size_t bucketCount = 25;
+
+    void record(std::chrono::steady_clock::duration duration);
+    void reset();
+
+    uint64_t getCount() const
+    {
+        return count;
+    }
+    uint64_t getMaxUs() const
+    {
+        return maxUs;
+    }
+    uint64_t getMeanUs() const
+    {
+        return count ? sumUs / count : 0;
+    }
+    const std::array<uint64_t, bucketCount>& getBuckets() const
+    {
+        return buckets;
+    }
+
+  private:
+    std::array<uint64_t, bucketCount> buckets{};
+    uint64_t count = 0;
+    uint64_t sumUs = 0;
+    uint64_t maxUs = 0;
+};
+
+/**
+ * @brief Records how long a stage took
+ */
+void record(Stage stage, std::chrono::steady_clock::duration duration);
+
+/**
+ * @brief Records a stage that started at the given time and ends now
+ */
+void record(Stage stage, std::chrono::steady_clock::time_point start);
+
+const Histogram& getHistogram(Stage stage);
+
+/**
+ * @brief Logs every stage that has samples to the journal
+ */
+void dumpToJournal();
+
+/**
+ * @brief Clears all the histograms
+ */
+void reset();
+
+/**
+ * @brief Dumps the histograms to the journal each time the process
+ * gets the given signal, e.g. SIGUSR1
+ */
+void dumpOnSignal(boost::asio::io_context& io, int signalNumber);
+
+/**
+ * @brief Puts the histograms on D-Bus at the given path, with methods to
+ * read each stage, dump them to the journal and reset them
+ *
+ * @return the interface, which stays on D-Bus while it is held
+ */
+std::shared_ptr<sdbusplus::asio::dbus_interface>
+    addDebugInterface(sdbusplus::asio::object_server& server,
+                      const std::string& path);
+
+} // namespace latency
+} // namespace button
+} // namespace phosphor
@@ -17,6 +17,7 @@
 #pragma once
 #include "config.h"
 
+#include "button_config.hpp"
 #include "button_factory.hpp"
 #include "button_handler.hpp"
 #include "button_interface.hpp"
@@ -28,9 +29,13 @@
 #include <unistd.h>
 
 #include <boost/asio/io_service.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <nlohmann/json.hpp>
 #include <phosphor-logging/elog-errors.hpp>
 
+#include <array>
 #include <chrono>
+#include <vector>
 
 static constexpr std::string_view POWER_BUTTON = "POWER_BUTTON";
 
@@ -45,7 +50,10 @@ class PowerButton :
         sdbusplus::server::object::object<
             sdbusplus::xyz::openbmc_project::Chassis::Buttons::server::Power>(
             bus, path),
-        ButtonIface(bus, buttonCfg, io)
+        ButtonIface(bus, buttonCfg, io),
+        holdThresholds(
+            std::get<powerButtonConfig>(config.extraInfo).holdThresholds),
+        holdTimer(io)
     {
         init();
     }
@@ -66,10 +74,22 @@ class PowerButton :
     {
         return POWER_DBUS_OBJECT_NAME;
     }
-    void updatePressedTime();
+    void updatePressedTime(gpioEventTime timestamp);
     auto getPressTime() const;
-    void handleEvent(bool asserted, std::string /* gpio_name */) override;
+    void handleEvent(const gpioEvent& event) override;
+    static constexpr std::array<configKey, 1> configKeys = {
+        {{"hold_thresholds", configValueType::array, false}}};
+    static void parseConfig(const nlohmann::json& buttonJson,
+                            buttonConfig& buttonCfg);
+    void startHoldTimer();
+    void emitHoldSignal(size_t level, std::chrono::milliseconds heldTime);
 
   protected:
-    decltype(std::chrono::steady_clock::now()) pressedTime;
+    gpioEventTime pressedTime;
+
+    // signals to emit while the button is held, by ascending time
+    const std::vector<holdThreshold> holdThresholds;
+    // number of hold thresholds passed in the current press
+    size_t holdLevel = 0;
+    boost::asio::steady_timer holdTimer;
 };
@@ -56,7 +56,7 @@ class ResetButton :
 
     void simPress() override;
 
-    void handleEvent(bool asserted, std::string /* gpio_name */) override;
+    void handleEvent(const gpioEvent& event) override;
 
     static constexpr std::string_view getFormFactorName()
     {
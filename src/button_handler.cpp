@@ -2,9 +2,15 @@
 
 #include "button_handler.hpp"
 
+#include "latency.hpp"
+
 #include <phosphor-logging/lg2.hpp>
 #include <xyz/openbmc_project/State/Chassis/server.hpp>
 #include <xyz/openbmc_project/State/Host/server.hpp>
+
+#include <charconv>
+#include <chrono>
+#include <string_view>
 namespace phosphor
 {
 namespace button
@@ -31,11 +37,77 @@ constexpr auto mapperObjPath = "/xyz/openbmc_project/object_mapper";
 constexpr auto mapperService = "xyz.openbmc_project.ObjectMapper";
 constexpr auto BMC_POSITION = 0;
 
-Handler::Handler(sdbusplus::bus::bus& bus) : bus(bus)
+constexpr auto dbusCallTimeout =
+    std::chrono::milliseconds(DBUS_CALL_TIMEOUT_MS);
+
+using PropertyValue = std::variant<std::string, bool, size_t>;
+
+Handler* inProcessHandler = nullptr;
+
+Handler::Handler(sdbusplus::asio::connection& bus, bool watchButtons) :
+    bus(bus)
+{
+    // Subscribe before the first lookups so no invalidation is missed
+    nameOwnerChangedMatch = std::make_unique<sdbusplus::bus::match_t>(
+        bus, sdbusRule::nameOwnerChanged(),
+        std::bind(std::mem_fn(&Handler::nameOwnerChanged), this,
+                  std::placeholders::_1));
+
+    interfacesAddedMatch = std::make_unique<sdbusplus::bus::match_t>(
+        bus, sdbusRule::interfacesAdded(),
+        std::bind(std::mem_fn(&Handler::interfacesChanged), this,
+                  std::placeholders::_1));
+
+    interfacesRemovedMatch = std::make_unique<sdbusplus::bus::match_t>(
+        bus, sdbusRule::interfacesRemoved(),
+        std::bind(std::mem_fn(&Handler::interfacesChanged), this,
+                  std::placeholders::_1));
+
+    std::string chassisObjectName{CHASSIS_STATE_OBJECT_NAME};
+    chassisPropertiesChangedMatch = std::make_unique<sdbusplus::bus::match_t>(
+        bus,
+        sdbusRule::type::signal() + sdbusRule::member("PropertiesChanged") +
+            sdbusRule::interface(propertyIface) +
+            sdbusRule::path_namespace(chassisObjectName.substr(
+                0, chassisObjectName.rfind('/'))) +
+            sdbusRule::argN(0, chassisIface),
+        std::bind(std::mem_fn(&Handler::chassisPropertiesChanged), this,
+                  std::placeholders::_1));
+
+    hostSelectorPropertiesChangedMatch =
+        std::make_unique<sdbusplus::bus::match_t>(
+            bus,
+            sdbusRule::propertiesChanged(HS_DBUS_OBJECT_NAME,
+                                         hostSelectorIface),
+            std::bind(std::mem_fn(&Handler::hostSelectorPropertiesChanged),
+                      this, std::placeholders::_1));
+
+    // In process the buttons call us directly, and matching their signals
+    // too would act on every press twice
+    if (!watchButtons)
+    {
+        return;
+    }
+
+    boost::asio::spawn(bus.get_io_context(),
+                       [this](boost::asio::yield_context yield) {
+        try
+        {
+            registerButtons(yield);
+        }
+        catch (const std::exception& e)
+        {
+            lg2::error("Failed to register the button handlers: {ERROR}",
+                       "ERROR", e);
+        }
+    });
+}
+void Handler::registerButtons(boost::asio::yield_context yield)
 {
     try
     {
-        if (!getService(POWER_DBUS_OBJECT_NAME, powerButtonIface).empty())
+        if (!getService(POWER_DBUS_OBJECT_NAME, powerButtonIface, yield)
+                 .empty())
         {
             lg2::info("Starting power button handler");
             powerButtonReleased = std::make_unique<sdbusplus::bus::match_t>(
@@ -43,16 +115,14 @@ Handler::Handler(sdbusplus::bus::bus& bus) : bus(bus)
                 sdbusRule::type::signal() + sdbusRule::member("Released") +
                     sdbusRule::path(POWER_DBUS_OBJECT_NAME) +
                     sdbusRule::interface(powerButtonIface),
-                std::bind(std::mem_fn(&Handler::powerReleased), this,
-                          std::placeholders::_1));
+                [this](sdbusplus::message::message&) { powerReleased(); });
 
             powerButtonLongPressed = std::make_unique<sdbusplus::bus::match_t>(
                 bus,
                 sdbusRule::type::signal() + sdbusRule::member("PressedLong") +
                     sdbusRule::path(POWER_DBUS_OBJECT_NAME) +
                     sdbusRule::interface(powerButtonIface),
-                std::bind(std::mem_fn(&Handler::longPowerPressed), this,
-                          std::placeholders::_1));
+                [this](sdbusplus::message::message&) { longPowerPressed(); });
         }
     }
     catch (const sdbusplus::exception::exception& e)
@@ -62,7 +132,7 @@ Handler::Handler(sdbusplus::bus::bus& bus) : bus(bus)
 
     try
     {
-        if (!getService(ID_DBUS_OBJECT_NAME, idButtonIface).empty())
+        if (!getService(ID_DBUS_OBJECT_NAME, idButtonIface, yield).empty())
         {
             lg2::info("Registering ID button handler");
             idButtonReleased = std::make_unique<sdbusplus::bus::match_t>(
@@ -70,8 +140,7 @@ Handler::Handler(sdbusplus::bus::bus& bus) : bus(bus)
                 sdbusRule::type::signal() + sdbusRule::member("Released") +
                     sdbusRule::path(ID_DBUS_OBJECT_NAME) +
                     sdbusRule::interface(idButtonIface),
-                std::bind(std::mem_fn(&Handler::idReleased), this,
-                          std::placeholders::_1));
+                [this](sdbusplus::message::message&) { idReleased(); });
         }
     }
     catch (const sdbusplus::exception::exception& e)
@@ -81,7 +150,8 @@ Handler::Handler(sdbusplus::bus::bus& bus) : bus(bus)
 
     try
     {
-        if (!getService(RESET_DBUS_OBJECT_NAME, resetButtonIface).empty())
+        if (!getService(RESET_DBUS_OBJECT_NAME, resetButtonIface, yield)
+                 .empty())
         {
             lg2::info("Registering reset button handler");
             resetButtonReleased = std::make_unique<sdbusplus::bus::match_t>(
@@ -89,8 +159,7 @@ Handler::Handler(sdbusplus::bus::bus& bus) : bus(bus)
                 sdbusRule::type::signal() + sdbusRule::member("Released") +
                     sdbusRule::path(RESET_DBUS_OBJECT_NAME) +
                     sdbusRule::interface(resetButtonIface),
-                std::bind(std::mem_fn(&Handler::resetReleased), this,
-                          std::placeholders::_1));
+                [this](sdbusplus::message::message&) { resetReleased(); });
         }
     }
     catch (const sdbusplus::exception::exception& e)
@@ -98,13 +167,37 @@ Handler::Handler(sdbusplus::bus::bus& bus) : bus(bus)
         // The button wasn't implemented
     }
 }
-bool Handler::isMultiHost()
+sdbusplus::message::message
+    Handler::call(sdbusplus::message::message& method,
+                  boost::asio::yield_context yield) const
+{
+    boost::system::error_code ec;
+    auto result = bus.async_send(
+        method, yield[ec],
+        std::chrono::duration_cast<std::chrono::microseconds>(dbusCallTimeout)
+            .count());
+
+    if (ec)
+    {
+        // Keep the D-Bus error name in the message so callers can
+        // still match on it, e.g. ResourceNotFound
+        std::string hint = method.get_member();
+        if (result.is_method_error() && result.get_error() != nullptr)
+        {
+            hint += std::string(": ") + result.get_error()->name;
+        }
+        throw sdbusplus::exception::SdBusError(ec.value(), hint.c_str());
+    }
+    return result;
+}
+bool Handler::isMultiHost(boost::asio::yield_context yield)
 {
     // return true in case host selector object is available
     bool ret = false;
     try
     {
-        ret = (!getService(HS_DBUS_OBJECT_NAME, hostSelectorIface).empty());
+        ret = (!getService(HS_DBUS_OBJECT_NAME, hostSelectorIface, yield)
+                    .empty());
     }
     // If ResourceNotFound, return false. Rethrow other exceptions
     catch (const sdbusplus::exception::exception& e)
@@ -118,21 +211,166 @@ bool Handler::isMultiHost()
     return ret;
 }
 std::string Handler::getService(const std::string& path,
-                                const std::string& interface) const
+                                const std::string& interface,
+                                boost::asio::yield_context yield) const
 {
-    auto method = bus.new_method_call(mapperService, mapperObjPath, mapperIface,
-                                      "GetObject");
-    method.append(path, std::vector{interface});
-    auto result = bus.call(method);
+    auto key = std::make_pair(path, interface);
+    if (auto it = serviceCache.find(key); it != serviceCache.end())
+    {
+        serviceCacheHits++;
+        return it->second;
+    }
+    serviceCacheMisses++;
+
+    std::string service;
+    try
+    {
+        auto method = bus.new_method_call(mapperService, mapperObjPath,
+                                          mapperIface, "GetObject");
+        method.append(path, std::vector{interface});
+        auto result = call(method, yield);
+
+        std::map<std::string, std::vector<std::string>> objectData;
+        result.read(objectData);
+
+        service = objectData.begin()->first;
+    }
+    // If ResourceNotFound, cache the miss. Rethrow other exceptions
+    catch (const sdbusplus::exception::exception& e)
+    {
+        if (std::string{e.what()}.find("ResourceNotFound") == std::string::npos)
+        {
+            throw;
+        }
+    }
+
+    lg2::debug(
+        "Service cache miss for {PATH} {INTERFACE}: {HITS} hits, {MISSES} misses",
+        "PATH", path, "INTERFACE", interface, "HITS", serviceCacheHits,
+        "MISSES", serviceCacheMisses);
 
-    std::map<std::string, std::vector<std::string>> objectData;
-    result.read(objectData);
+    serviceCache.emplace(std::move(key), service);
+    return service;
+}
+void Handler::nameOwnerChanged(sdbusplus::message::message& msg)
+{
+    std::string name;
+    std::string oldOwner;
+    std::string newOwner;
+    msg.read(name, oldOwner, newOwner);
+
+    // Mirrored properties are only valid while their owner is connected
+    if (!oldOwner.empty())
+    {
+        std::erase_if(poweredOnMirror, [&oldOwner](const auto& entry) {
+            return entry.second.owner == oldOwner;
+        });
+        if (hostSelectorMirror && hostSelectorMirror->owner == oldOwner)
+        {
+            hostSelectorMirror.reset();
+        }
+    }
+
+    // The mapper only ever hands out well-known names
+    if (name.empty() || name.front() == ':')
+    {
+        return;
+    }
+
+    auto erased = std::erase_if(serviceCache, [&](const auto& entry) {
+        return entry.second.empty() ? !newOwner.empty() : entry.second == name;
+    });
+    if (erased)
+    {
+        lg2::debug("Dropped {COUNT} cached services on {NAME} owner change",
+                   "COUNT", erased, "NAME", name);
+    }
+}
+void Handler::interfacesChanged(sdbusplus::message::message& msg)
+{
+    sdbusplus::message::object_path objPath;
+    msg.read(objPath);
+
+    std::erase_if(serviceCache, [&objPath](const auto& entry) {
+        return entry.first.first == objPath.str;
+    });
+}
+void Handler::chassisPropertiesChanged(sdbusplus::message::message& msg)
+{
+    // Only the chassisN objects, e.g. not chassis_system
+    std::string_view objPath{msg.get_path()};
+    std::string_view prefix{CHASSIS_STATE_OBJECT_NAME};
+    if (!objPath.starts_with(prefix) || objPath.size() == prefix.size())
+    {
+        return;
+    }
+    size_t hostNumber = 0;
+    auto [ptr, ec] = std::from_chars(objPath.data() + prefix.size(),
+                                     objPath.data() + objPath.size(),
+                                     hostNumber);
+    if (ec != std::errc() || ptr != objPath.data() + objPath.size())
+    {
+        return;
+    }
+
+    try
+    {
+        std::string interface;
+        std::map<std::string, PropertyValue> properties;
+        msg.read(interface, properties);
+
+        auto it = properties.find("CurrentPowerState");
+        if (it == properties.end())
+        {
+            return;
+        }
+        poweredOnMirror.insert_or_assign(
+            hostNumber,
+            Mirror<bool>{msg.get_sender(),
+                         Chassis::PowerState::On ==
+                             Chassis::convertPowerStateFromString(
+                                 std::get<std::string>(it->second))});
+    }
+    catch (const std::exception& e)
+    {
+        // Fall back to reading the property on the next press
+        poweredOnMirror.erase(hostNumber);
+        lg2::error("Error reading {PATH} PropertiesChanged: {ERROR}", "PATH",
+                   msg.get_path(), "ERROR", e);
+    }
+}
+void Handler::hostSelectorPropertiesChanged(sdbusplus::message::message& msg)
+{
+    try
+    {
+        std::string interface;
+        std::map<std::string, PropertyValue> properties;
+        msg.read(interface, properties);
 
-    return objectData.begin()->first;
+        auto it = properties.find("Position");
+        if (it == properties.end())
+        {
+            return;
+        }
+        hostSelectorMirror = Mirror<size_t>{msg.get_sender(),
+                                            std::get<size_t>(it->second)};
+    }
+    catch (const std::exception& e)
+    {
+        // Fall back to reading the property on the next press
+        hostSelectorMirror.reset();
+        lg2::error("Error reading Host selector PropertiesChanged: {ERROR}",
+                   "ERROR", e);
+    }
 }
-size_t Handler::getHostSelectorValue()
+size_t Handler::getHostSelectorValue(boost::asio::yield_context yield)
 {
-    auto HSService = getService(HS_DBUS_OBJECT_NAME, hostSelectorIface);
+    if (hostSelectorMirror)
+    {
+        return hostSelectorMirror->value;
+    }
+
+    auto HSService = getService(HS_DBUS_OBJECT_NAME, hostSelectorIface, yield);
 
     if (HSService.empty())
     {
@@ -145,12 +383,18 @@ size_t Handler::getHostSelectorValue()
         auto method = bus.new_method_call(
             HSService.c_str(), HS_DBUS_OBJECT_NAME, propertyIface, "Get");
         method.append(hostSelectorIface, "Position");
-        auto result = bus.call(method);
+        auto result = call(method, yield);
 
         std::variant<size_t> HSPositionVariant;
         result.read(HSPositionVariant);
 
         auto position = std::get<size_t>(HSPositionVariant);
+
+        // A PropertiesChanged received meanwhile is newer, so keep it
+        if (!hostSelectorMirror)
+        {
+            hostSelectorMirror = Mirror<size_t>{result.get_sender(), position};
+        }
         return position;
     }
     catch (const sdbusplus::exception::exception& e)
@@ -159,24 +403,37 @@ size_t Handler::getHostSelectorValue()
         throw;
     }
 }
-bool Handler::poweredOn(size_t hostNumber) const
+bool Handler::poweredOn(size_t hostNumber,
+                        boost::asio::yield_context yield) const
 {
+    if (auto it = poweredOnMirror.find(hostNumber);
+        it != poweredOnMirror.end())
+    {
+        return it->second.value;
+    }
+
     auto chassisObjectName = CHASSIS_STATE_OBJECT_NAME +
                              std::to_string(hostNumber);
-    auto service = getService(chassisObjectName.c_str(), chassisIface);
+    auto service = getService(chassisObjectName.c_str(), chassisIface, yield);
     auto method = bus.new_method_call(
         service.c_str(), chassisObjectName.c_str(), propertyIface, "Get");
     method.append(chassisIface, "CurrentPowerState");
-    auto result = bus.call(method);
+    auto result = call(method, yield);
 
     std::variant<std::string> state;
     result.read(state);
 
-    return Chassis::PowerState::On ==
-           Chassis::convertPowerStateFromString(std::get<std::string>(state));
+    bool on = Chassis::PowerState::On == Chassis::convertPowerStateFromString(
+                                             std::get<std::string>(state));
+
+    // A PropertiesChanged received meanwhile is newer, so keep it
+    poweredOnMirror.emplace(hostNumber, Mirror<bool>{result.get_sender(), on});
+    return on;
 }
 
-void Handler::handlePowerEvent(PowerEvent powerEventType)
+void Handler::handlePowerEvent(PowerEvent powerEventType,
+                               std::chrono::steady_clock::time_point received,
+                               boost::asio::yield_context yield)
 {
     std::string objPathName;
     std::string dbusIfaceName;
@@ -184,10 +441,10 @@ void Handler::handlePowerEvent(PowerEvent powerEventType)
     std::variant<Host::Transition, Chassis::Transition> transition;
 
     size_t hostNumber = 0;
-    auto isMultiHostSystem = isMultiHost();
+    auto isMultiHostSystem = isMultiHost(yield);
     if (isMultiHostSystem)
     {
-        hostNumber = getHostSelectorValue();
+        hostNumber = getHostSelectorValue(yield);
         lg2::info("Multi host system detected : {POSITION}", "POSITION",
                   hostNumber);
     }
@@ -213,7 +470,7 @@ void Handler::handlePowerEvent(PowerEvent powerEventType)
 
             transition = Host::Transition::On;
 
-            if (poweredOn(hostNumber))
+            if (poweredOn(hostNumber, yield))
             {
                 transition = Host::Transition::Off;
             }
@@ -243,7 +500,7 @@ void Handler::handlePowerEvent(PowerEvent powerEventType)
                 return;
 #endif
             }
-            else if (!poweredOn(hostNumber))
+            else if (!poweredOn(hostNumber, yield))
             {
                 lg2::info("Power is off so ignoring long power button press");
                 return;
@@ -259,7 +516,7 @@ void Handler::handlePowerEvent(PowerEvent powerEventType)
             dbusIfaceName = hostIface;
             transitionName = "RequestedHostTransition";
 
-            if (!poweredOn(hostNumber))
+            if (!poweredOn(hostNumber, yield))
             {
                 lg2::info("Power is off so ignoring reset button press");
                 return;
@@ -278,56 +535,91 @@ void Handler::handlePowerEvent(PowerEvent powerEventType)
             return;
         }
     }
-    auto service = getService(objPathName.c_str(), dbusIfaceName);
+    auto service = getService(objPathName.c_str(), dbusIfaceName, yield);
     auto method = bus.new_method_call(service.c_str(), objPathName.c_str(),
                                       propertyIface, "Set");
     method.append(dbusIfaceName, transitionName, transition);
-    bus.call(method);
+    call(method, yield);
+    // Only presses that set a transition are counted
+    latency::record(latency::Stage::signalToTransition, received);
 }
-void Handler::powerReleased(sdbusplus::message::message& /* msg */)
+void Handler::powerReleased()
 {
-    try
-    {
-        handlePowerEvent(PowerEvent::powerReleased);
-    }
-    catch (const sdbusplus::exception::exception& e)
-    {
-        lg2::error("Failed power state change on a power button press: {ERROR}",
-                   "ERROR", e);
-    }
+    auto received = std::chrono::steady_clock::now();
+    boost::asio::spawn(bus.get_io_context(),
+                       [this, received](boost::asio::yield_context yield) {
+        try
+        {
+            handlePowerEvent(PowerEvent::powerReleased, received, yield);
+        }
+        catch (const std::exception& e)
+        {
+            lg2::error(
+                "Failed power state change on a power button press: {ERROR}",
+                "ERROR", e);
+        }
+    });
 }
-void Handler::longPowerPressed(sdbusplus::message::message& /* msg */)
+void Handler::longPowerPressed()
 {
-    try
-    {
-        handlePowerEvent(PowerEvent::longPowerPressed);
-    }
-    catch (const sdbusplus::exception::exception& e)
-    {
-        lg2::error("Failed powering off on long power button press: {ERROR}",
-                   "ERROR", e);
-    }
+    auto received = std::chrono::steady_clock::now();
+    boost::asio::spawn(bus.get_io_context(),
+                       [this, received](boost::asio::yield_context yield) {
+        try
+        {
+            handlePowerEvent(PowerEvent::longPowerPressed, received, yield);
+        }
+        catch (const std::exception& e)
+        {
+            lg2::error(
+                "Failed powering off on long power button press: {ERROR}",
+                "ERROR", e);
+        }
+    });
 }
 
-void Handler::resetReleased(sdbusplus::message::message& /* msg */)
+void Handler::resetReleased()
 {
-    try
-    {
-        handlePowerEvent(PowerEvent::resetReleased);
-    }
-    catch (const sdbusplus::exception::exception& e)
-    {
-        lg2::error("Failed power state change on a reset button press: {ERROR}",
-                   "ERROR", e);
-    }
+    auto received = std::chrono::steady_clock::now();
+    boost::asio::spawn(bus.get_io_context(),
+                       [this, received](boost::asio::yield_context yield) {
+        try
+        {
+            handlePowerEvent(PowerEvent::resetReleased, received, yield);
+        }
+        catch (const std::exception& e)
+        {
+            lg2::error(
+                "Failed power state change on a reset button press: {ERROR}",
+                "ERROR", e);
+        }
+    });
 }
 
-void Handler::idReleased(sdbusplus::message::message& /* msg */)
+void Handler::idReleased()
+{
+    auto received = std::chrono::steady_clock::now();
+    boost::asio::spawn(bus.get_io_context(),
+                       [this, received](boost::asio::yield_context yield) {
+        try
+        {
+            toggleIdLed(received, yield);
+        }
+        catch (const std::exception& e)
+        {
+            lg2::error("Error toggling ID LED group on ID button press: {ERROR}",
+                       "ERROR", e);
+        }
+    });
+}
+
+void Handler::toggleIdLed(std::chrono::steady_clock::time_point received,
+                          boost::asio::yield_context yield)
 {
     std::string groupPath{ledGroupBasePath};
     groupPath += ID_LED_GROUP;
 
-    auto service = getService(groupPath, ledGroupIface);
+    auto service = getService(groupPath, ledGroupIface, yield);
 
     if (service.empty())
     {
@@ -336,33 +628,26 @@ void Handler::idReleased(sdbusplus::message::message& /* msg */)
         return;
     }
 
-    try
-    {
-        auto method = bus.new_method_call(service.c_str(), groupPath.c_str(),
-                                          propertyIface, "Get");
-        method.append(ledGroupIface, "Asserted");
-        auto result = bus.call(method);
+    auto method = bus.new_method_call(service.c_str(), groupPath.c_str(),
+                                      propertyIface, "Get");
+    method.append(ledGroupIface, "Asserted");
+    auto result = call(method, yield);
 
-        std::variant<bool> state;
-        result.read(state);
+    std::variant<bool> state;
+    result.read(state);
 
-        state = !std::get<bool>(state);
+    state = !std::get<bool>(state);
 
-        lg2::info(
-            "Changing ID LED group state on ID LED press, GROUP = {GROUP}, STATE = {STATE}",
-            "GROUP", groupPath, "STATE", std::get<bool>(state));
+    lg2::info(
+        "Changing ID LED group state on ID LED press, GROUP = {GROUP}, STATE = {STATE}",
+        "GROUP", groupPath, "STATE", std::get<bool>(state));
 
-        method = bus.new_method_call(service.c_str(), groupPath.c_str(),
-                                     propertyIface, "Set");
+    method = bus.new_method_call(service.c_str(), groupPath.c_str(),
+                                 propertyIface, "Set");
 
-        method.append(ledGroupIface, "Asserted", state);
-        result = bus.call(method);
-    }
-    catch (const sdbusplus::exception::exception& e)
-    {
-        lg2::error("Error toggling ID LED group on ID button press: {ERROR}",
-                   "ERROR", e);
-    }
+    method.append(ledGroupIface, "Asserted", state);
+    call(method, yield);
+    latency::record(latency::Stage::signalToLed, received);
 }
 } // namespace button
 } // namespace phosphor
@@ -1,15 +1,92 @@
 #include "button_handler.hpp"
+#include "latency.hpp"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <phosphor-logging/lg2.hpp>
+#include <sdbusplus/asio/object_server.hpp>
+
+#include <algorithm>
+#include <csignal>
+#include <cstdint>
+#include <functional>
+
+/**
+ * @brief How much work each wakeup of the event loop found. The bus
+ * connection runs one handler per queued message, so this shows how many
+ * messages are drained per wakeup.
+ */
+struct loopStats
+{
+    uint64_t wakeups = 0;
+    uint64_t handlers = 0;
+    uint64_t maxHandlers = 0;
+
+    void log() const
+    {
+        lg2::info(
+            "Event loop: {WAKEUPS} wakeups ran {HANDLERS} handlers, at most {MAX} in one wakeup",
+            "WAKEUPS", wakeups, "HANDLERS", handlers, "MAX", maxHandlers);
+    }
+};
 
 int main(void)
 {
-    auto bus = sdbusplus::bus::new_default();
+    boost::asio::io_context io;
+    auto conn = std::make_shared<sdbusplus::asio::connection>(io);
+    conn->request_name("xyz.openbmc_project.Chassis.Buttons.Handler");
 
-    phosphor::button::Handler handler{bus};
+    phosphor::button::Handler handler{*conn};
 
-    while (true)
+    // Expose the press handling latencies for debugging
+    sdbusplus::asio::object_server server{conn};
+    auto latencyIface = phosphor::button::latency::addDebugInterface(
+        server, phosphor::button::latency::latencyObjectPath);
+    phosphor::button::latency::dumpOnSignal(io, SIGUSR1);
+
+    loopStats stats;
+
+    boost::asio::signal_set statsSignal{io, SIGUSR1};
+    std::function<void(const boost::system::error_code&, int)> logStats =
+        [&](const boost::system::error_code& ec, int /* signal */) {
+        if (ec)
+        {
+            return;
+        }
+        stats.log();
+        statsSignal.async_wait(logStats);
+    };
+    statsSignal.async_wait(logStats);
+
+    // Stop the loop on SIGTERM and SIGINT so the handler and the bus
+    // connection are torn down normally
+    boost::asio::signal_set stopSignals{io, SIGTERM, SIGINT};
+    stopSignals.async_wait(
+        [&io](const boost::system::error_code& ec, int signal) {
+        if (ec)
+        {
+            return;
+        }
+        lg2::info("Stopping on signal {SIGNAL}", "SIGNAL", signal);
+        io.stop();
+    });
+
+    // Each wakeup waits for one handler and then runs every other one
+    // that's ready, which drains all the queued bus messages
+    while (!io.stopped())
     {
-        bus.process_discard();
-        bus.wait();
+        auto handlers = io.run_one();
+        if (handlers == 0)
+        {
+            break;
+        }
+        handlers += io.poll();
+
+        stats.wakeups++;
+        stats.handlers += handlers;
+        stats.maxHandlers = std::max<uint64_t>(stats.maxHandlers, handlers);
     }
+
+    stats.log();
     return 0;
 }
@@ -18,109 +18,103 @@
 
 #include "gpio.hpp"
 
-#include "xyz/openbmc_project/Chassis/Common/error.hpp"
+#include "gpio_registry.hpp"
 
 #include <error.h>
 #include <fcntl.h>
 #include <unistd.h>
 
-#include <gpiod.hpp>
 #include <gpioplus/utility/aspeed.hpp>
 #include <nlohmann/json.hpp>
 #include <phosphor-logging/lg2.hpp>
 
-#include <filesystem>
-#include <fstream>
+#include <algorithm>
+#include <set>
+#include <unordered_map>
 
-const std::string gpioDev = "/sys/class/gpio";
-std::map<std::string, gpiod::line> allGpios;
-
-namespace fs = std::filesystem;
-
-void closeAllGpio()
+// the gpiochips, and where each label is in the list
+struct gpioChips
 {
-    // Loop through all gpios and close them
-    std::string msg = "Closing all button gpio lines.";
-    lg2::info(msg.c_str());
-    while (allGpios.size() != 0)
-    {
-        auto it = allGpios.begin();
-        closeGpio(it->first);
-    }
-}
+    std::vector<gpioChipInfo> chips;
+    std::unordered_map<std::string, size_t> byLabel;
+};
 
-void closeGpio(const std::string& buttonName)
+static gpioChips scanGpioChips()
 {
-    // Find the GPIO line
-    gpiod::line gpioLine;
-    try
-    {
-        gpioLine = allGpios.at(buttonName);
-    }
-    catch (const std::exception& e)
-    {
-        std::string errMsg = "Button name not found: " + buttonName;
-        lg2::error(errMsg.c_str());
-        return;
-    }
-    if (!gpioLine)
+    gpioChips result;
+    auto& backend = getGpioBackend();
+    for (const auto& path : backend.listChips())
     {
-        std::string errMsg = "Failed to find the " + buttonName + " line";
-        lg2::error(errMsg.c_str());
-        return;
-    }
-    try
-    {
-        // Try to release the line
-        if (gpioLine.is_used())
+        try
         {
-            gpioLine.release();
+            result.chips.push_back(backend.openChip(path)->getInfo());
+        }
+        catch (const std::exception& e)
+        {
+            lg2::error("Failed to open {CHIP}: {ERROR}", "CHIP", path,
+                       "ERROR", e);
         }
-        // Erase the line from allGpios
-        allGpios.erase(buttonName);
     }
-    catch (const std::exception& e)
+
+    // Keep a stable order, so a line name on two chips always resolves
+    // to the same one
+    std::sort(result.chips.begin(), result.chips.end(),
+              [](const auto& a, const auto& b) { return a.path < b.path; });
+    for (size_t index = 0; index < result.chips.size(); index++)
     {
-        std::string errMsg = "Failed to release the " + buttonName + " line";
-        lg2::error(errMsg.c_str());
-        return;
+        result.byLabel.emplace(result.chips[index].label, index);
     }
-    std::string msg = "Released the " + buttonName + " line";
-    lg2::info(msg.c_str());
+    return result;
 }
 
-uint32_t getGpioBase()
+// the chips as of the last scan
+static gpioChips chipCache;
+static bool chipsScanned = false;
+
+void rescanGpioChips()
 {
-    // Look for a /sys/class/gpio/gpiochip*/label file
-    // with a value of GPIO_BASE_LABEL_NAME.  Then read
-    // the base value from the 'base' file in that directory.
-#ifdef LOOKUP_GPIO_BASE
-    for (auto& f : fs::directory_iterator(gpioDev))
+    chipCache = scanGpioChips();
+    chipsScanned = true;
+}
+
+static const gpioChips& getGpioChipCache()
+{
+    if (!chipsScanned)
     {
-        std::string path{f.path()};
-        if (path.find("gpiochip") == std::string::npos)
-        {
-            continue;
-        }
+        rescanGpioChips();
+    }
+    return chipCache;
+}
 
-        std::ifstream labelStream{path + "/label"};
-        std::string label;
-        labelStream >> label;
+const std::vector<gpioChipInfo>& getGpioChips()
+{
+    return getGpioChipCache().chips;
+}
 
-        if (label == GPIO_BASE_LABEL_NAME)
-        {
-            uint32_t base;
-            std::ifstream baseStream{path + "/base"};
-            baseStream >> base;
-            return base;
-        }
+const gpioChipInfo* getGpioChipByLabel(const std::string& label)
+{
+    const auto& cache = getGpioChipCache();
+    auto chip = cache.byLabel.find(label);
+    if (chip == cache.byLabel.end())
+    {
+        return nullptr;
     }
+    return &cache.chips[chip->second];
+}
 
-    lg2::error("Could not find GPIO base");
-    throw std::runtime_error("Could not find GPIO base!");
-#else
-    return 0;
+uint32_t getGpioNum(const std::string& gpioPin)
+{
+    // Offsets are relative to the chip on the character device ABI, so
+    // there is no base to add, only the chip to check for
+#ifdef LOOKUP_GPIO_BASE
+    if (getGpioChipByLabel(GPIO_BASE_LABEL_NAME) == nullptr)
+    {
+        lg2::error("Could not find the {LABEL} gpiochip", "LABEL",
+                   GPIO_BASE_LABEL_NAME);
+        throw std::runtime_error("Could not find GPIO base!");
+    }
 #endif
+    return gpioplus::utility::aspeed::nameToOffset(gpioPin);
 }
 
 int configGroupGpio(buttonConfig& buttonIFConfig)
@@ -144,108 +138,148 @@ int configGroupGpio(buttonConfig& buttonIFConfig)
     return result;
 }
 
-static void waitForGPIOEvent(gpioInfo& gpioConfig)
+// where a named line was found
+struct gpioLineLocation
 {
-    // This is an async function that is called upon a change
-    // to the gpio that is being watched
-    gpioConfig.streamDesc.get()->async_wait(
-        boost::asio::posix::stream_descriptor::wait_read,
-        [&gpioConfig](const boost::system::error_code ec) {
-        if (gpioConfig.button_name == "")
-        {
-            lg2::error("Name for button is an empty string");
-            throw sdbusplus::xyz::openbmc_project::Chassis::Common::Error::
-                IOError();
-        }
-        if (ec)
+    std::string chip;
+    unsigned int offset;
+};
+
+// Finds the chip and offset of each of the given line names. Every chip is
+// opened and its lines read once, whatever the number of names, and the
+// scan stops as soon as all the names have been found.
+static std::map<std::string, gpioLineLocation>
+    findGpioLines(const std::set<std::string>& names)
+{
+    std::map<std::string, gpioLineLocation> lines;
+
+    for (const auto& chipInfo : getGpioChips())
+    {
+        try
         {
-            closeAllGpio();
-            std::string errMsg = gpioConfig.button_name +
-                                 " fd handler error: " + ec.message();
-            lg2::error(errMsg.c_str());
-            // TODO: throw here to force power-control to restart?
-            throw sdbusplus::xyz::openbmc_project::Chassis::Common::Error::
-                IOError();
+            auto chip = getGpioBackend().openChip(chipInfo.path);
+            for (unsigned int offset = 0; offset < chipInfo.numLines; offset++)
+            {
+                auto name = chip->getLineName(offset);
+                if (names.contains(name) && !lines.contains(name))
+                {
+                    lines.emplace(name,
+                                  gpioLineLocation{chipInfo.path, offset});
+                }
+            }
         }
-        if (!gpioConfig.userdata)
+        catch (const std::exception& e)
         {
-            closeAllGpio();
-            std::string errMsg = "Failed to find the " +
-                                 gpioConfig.button_name + " userdata";
-            lg2::error(errMsg.c_str());
-            throw sdbusplus::xyz::openbmc_project::Chassis::Common::Error::
-                IOError();
+            lg2::error("Failed to open {CHIP}: {ERROR}", "CHIP",
+                       chipInfo.path, "ERROR", e);
         }
-        if (!gpioConfig.handler)
+
+        if (lines.size() == names.size())
         {
-            closeAllGpio();
-            std::string errMsg = "Failed to find the " +
-                                 gpioConfig.button_name + " handler";
-            lg2::error(errMsg.c_str());
-            throw sdbusplus::xyz::openbmc_project::Chassis::Common::Error::
-                IOError();
+            break;
         }
-        gpiod::line_event line_event = gpioConfig.line.event_read();
-        gpioConfig.handler(gpioConfig.userdata,
-                           line_event.event_type == gpioConfig.direction,
-                           gpioConfig.gpio_name);
-        waitForGPIOEvent(gpioConfig);
-    });
+    }
+    return lines;
 }
 
-int configGpio(gpioInfo& gpioConfig)
+// Finds the chip and offset of every gpio that isn't resolved yet, in one
+// scan of the chips. Lines loaded from the gpio defs cache already are.
+void resolveGpios(std::vector<buttonConfig>& buttonConfigs)
 {
-    // Find the GPIO line
-    gpioConfig.line = gpiod::find_line(gpioConfig.gpio_name);
-    if (!gpioConfig.line)
+    std::set<std::string> names;
+    for (const auto& buttonCfg : buttonConfigs)
     {
-        std::string errMsg = "Failed to find the " + gpioConfig.gpio_name +
-                             " line for " + gpioConfig.button_name;
-        lg2::error(errMsg.c_str());
-        return -1;
+        for (const auto& gpioCfg : buttonCfg.gpios)
+        {
+            if (gpioCfg.chip.empty())
+            {
+                names.insert(gpioCfg.gpio_name);
+            }
+        }
+    }
+    if (names.empty())
+    {
+        return;
+    }
+
+    // Chips can be probed after we start, e.g. behind an i2c expander, so
+    // look again each time rather than only at the first lookup
+    auto start = std::chrono::steady_clock::now();
+    rescanGpioChips();
+    auto lines = findGpioLines(names);
+    auto took = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    lg2::info("Found {FOUND} of {COUNT} GPIO line names in {TIME} us", "FOUND",
+              lines.size(), "COUNT", names.size(), "TIME", took.count());
+
+    for (auto& buttonCfg : buttonConfigs)
+    {
+        for (auto& gpioCfg : buttonCfg.gpios)
+        {
+            auto line = lines.find(gpioCfg.gpio_name);
+            if (gpioCfg.chip.empty() && line != lines.end())
+            {
+                gpioCfg.chip = line->second.chip;
+                gpioCfg.offset = line->second.offset;
+            }
+        }
     }
+}
 
-    // Add this gpio to map of all gpios
-    allGpios[gpioConfig.button_name] = gpioConfig.line;
-    try
+bool isSameButtonConfig(const buttonConfig& a, const buttonConfig& b)
+{
+    if (a.formFactorName != b.formFactorName || a.extraInfo != b.extraInfo ||
+        a.gpios.size() != b.gpios.size())
     {
-        gpioConfig.line.request(
-            {"button-handler", gpiod::line_request::EVENT_BOTH_EDGES, {}});
+        return false;
     }
-    catch (const std::exception&)
+    return std::equal(a.gpios.begin(), a.gpios.end(), b.gpios.begin(),
+                      [](const gpioInfo& x, const gpioInfo& y) {
+        return x.button_name == y.button_name && x.gpio_name == y.gpio_name &&
+               x.direction == y.direction && x.debounceTime == y.debounceTime;
+    });
+}
+
+int getGpioValue(const gpioInfo& gpioConfig)
+{
+    if (!gpioConfig.registry)
     {
-        closeAllGpio();
-        std::string errMsg = "Failed to request events for " +
-                             gpioConfig.button_name;
-        lg2::error(errMsg.c_str());
-        return -1;
+        throw std::runtime_error("GPIO " + gpioConfig.gpio_name +
+                                 " is not requested");
     }
+    return gpioConfig.registry->getValue(gpioConfig);
+}
 
-    // Get a file descriptor to be used for this event
-    int gpioLineFd = gpioConfig.line.event_get_fd();
-    if (gpioLineFd < 0)
+std::vector<int> getGpioValues(const std::vector<gpioInfo>& gpios)
+{
+    if (gpios.empty())
     {
-        closeAllGpio();
-        std::string errMsg = "Failed to name " + gpioConfig.button_name + " fd";
-        lg2::error(errMsg.c_str());
-        return -1;
+        return {};
     }
-    try
+    if (!gpios[0].registry)
     {
-        // Assign the fd to this stream descriptor
-        gpioConfig.streamDesc.get()->assign(gpioLineFd);
+        throw std::runtime_error("GPIO " + gpios[0].gpio_name +
+                                 " is not requested");
     }
-    catch (const std::exception&)
+    return gpios[0].registry->getValues(gpios);
+}
+
+int configGpio(gpioInfo& gpioConfig)
+{
+    if (!gpioConfig.registry)
     {
-        closeAllGpio();
-        std::string errMsg = "Failed assign line to stream descriptor for " +
-                             gpioConfig.button_name;
+        std::string errMsg = "Failed to find the " + gpioConfig.gpio_name +
+                             " line for " + gpioConfig.button_name;
         lg2::error(errMsg.c_str());
         return -1;
     }
+    return gpioConfig.registry->bind(gpioConfig);
+}
 
-    std::string msg = "Button GPIO configured: " + gpioConfig.button_name;
-    lg2::info(msg.c_str());
-    waitForGPIOEvent(gpioConfig);
-    return 0;
+void closeGpio(const gpioInfo& gpioConfig)
+{
+    if (gpioConfig.registry)
+    {
+        gpioConfig.registry->unbind(gpioConfig);
+    }
 }
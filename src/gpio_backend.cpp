@@ -0,0 +1,153 @@
+#include "gpio_backend.hpp"
+
+#include <gpiod.hpp>
+
+#include <filesystem>
+
+const std::string gpioChipDir = "/dev";
+
+class gpiodLineRequest : public GpioLineRequest
+{
+  public:
+    explicit gpiodLineRequest(gpiod::line_request&& request) :
+        request(std::move(request)), eventBuffer(maxEdgesPerRead)
+    {}
+
+    int fd() const override
+    {
+        return request.fd();
+    }
+
+    size_t numLines() const override
+    {
+        return request.num_lines();
+    }
+
+    size_t readEdges(std::vector<gpioEdge>& edges) override
+    {
+        request.read_edge_events(eventBuffer);
+        edges.clear();
+        for (const auto& event : eventBuffer)
+        {
+            edges.push_back(gpioEdge{
+                event.line_offset(),
+                event.type() == gpiod::edge_event::event_type::RISING_EDGE,
+                event.line_seqno(),
+                gpioEventTime(std::chrono::nanoseconds(
+                    event.timestamp_ns().ns()))});
+        }
+        return edges.size();
+    }
+
+    bool waitEdges(std::chrono::nanoseconds timeout) override
+    {
+        return request.wait_edge_events(timeout);
+    }
+
+    int getValue(unsigned int offset) override
+    {
+        return request.get_value(offset) == gpiod::line::value::ACTIVE ? 1
+                                                                       : 0;
+    }
+
+    std::vector<int>
+        getValues(const std::vector<unsigned int>& offsets) override
+    {
+        gpiod::line::offsets lineOffsets(offsets.begin(), offsets.end());
+        auto values = request.get_values(lineOffsets);
+        std::vector<int> result(values.size(), 0);
+        for (size_t line = 0; line < values.size(); line++)
+        {
+            result[line] = values[line] == gpiod::line::value::ACTIVE ? 1 : 0;
+        }
+        return result;
+    }
+
+  private:
+    gpiod::line_request request;
+    gpiod::edge_event_buffer eventBuffer;
+};
+
+class gpiodChip : public GpioChip
+{
+  public:
+    explicit gpiodChip(const std::string& path) : path(path), chip(path) {}
+
+    gpioChipInfo getInfo() override
+    {
+        auto info = chip.get_info();
+        return gpioChipInfo{path, info.name(), info.label(),
+                            info.num_lines()};
+    }
+
+    std::string getLineName(unsigned int offset) override
+    {
+        return chip.get_line_info(offset).name();
+    }
+
+    std::unique_ptr<GpioLineRequest>
+        requestLines(const std::vector<gpioLineSettings>& lines) override
+    {
+        gpiod::line_config lineConfig;
+        for (const auto& line : lines)
+        {
+            gpiod::line_settings settings;
+            // Event timestamps must be on the steady_clock timeline
+            settings.set_direction(gpiod::line::direction::INPUT)
+                .set_edge_detection(gpiod::line::edge::BOTH)
+                .set_event_clock(gpiod::line::clock::MONOTONIC);
+            if (line.debounceTime.count() > 0)
+            {
+                settings.set_debounce_period(line.debounceTime);
+            }
+            lineConfig.add_line_settings(line.offset, settings);
+        }
+
+        return std::make_unique<gpiodLineRequest>(
+            chip.prepare_request()
+                .set_consumer("button-handler")
+                .set_line_config(lineConfig)
+                .do_request());
+    }
+
+  private:
+    std::string path;
+    gpiod::chip chip;
+};
+
+// The gpiochip character devices, through libgpiod
+class gpiodBackend : public GpioBackend
+{
+  public:
+    std::vector<std::string> listChips() override
+    {
+        std::vector<std::string> paths;
+        for (const auto& entry :
+             std::filesystem::directory_iterator(gpioChipDir))
+        {
+            if (gpiod::is_gpiochip_device(entry.path()))
+            {
+                paths.push_back(entry.path());
+            }
+        }
+        return paths;
+    }
+
+    std::unique_ptr<GpioChip> openChip(const std::string& path) override
+    {
+        return std::make_unique<gpiodChip>(path);
+    }
+};
+
+static gpiodBackend defaultBackend;
+static GpioBackend* currentBackend = &defaultBackend;
+
+GpioBackend& getGpioBackend()
+{
+    return *currentBackend;
+}
+
+void setGpioBackend(GpioBackend* backend)
+{
+    currentBackend = backend ? backend : &defaultBackend;
+}
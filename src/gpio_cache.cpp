@@ -0,0 +1,399 @@
+#include "config.h"
+
+#include "gpio_cache.hpp"
+
+#include "button_config.hpp"
+
+#include <gpiod.hpp>
+#include <phosphor-logging/lg2.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+namespace fs = std::filesystem;
+
+// "PBGC" followed by the format version. The cache is only read back on
+// the machine that wrote it, so values are stored in host byte order.
+constexpr uint32_t cacheMagic = 0x43474250;
+constexpr uint32_t cacheVersion = 2;
+
+// which settings follow a button config in the cache
+enum class extraInfoKind : uint8_t
+{
+    none,
+    powerButton,
+    hostSelector
+};
+
+// identifies the gpio defs file the cache was made from
+struct gpioDefsStamp
+{
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t hash = 0;
+};
+
+// FNV-1a, which is plenty to notice the file being edited
+static uint64_t hashBytes(const std::string& bytes)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (unsigned char c : bytes)
+    {
+        hash ^= c;
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+static std::string readFile(const std::string& path)
+{
+    std::ifstream file{path, std::ios::binary};
+    if (!file)
+    {
+        throw std::runtime_error("Failed to open " + path);
+    }
+    return {std::istreambuf_iterator<char>(file),
+            std::istreambuf_iterator<char>()};
+}
+
+static gpioDefsStamp getGpioDefsStamp(const std::string& gpioDefsPath)
+{
+    gpioDefsStamp stamp;
+    stamp.size = fs::file_size(gpioDefsPath);
+    stamp.mtime =
+        fs::last_write_time(gpioDefsPath).time_since_epoch().count();
+    stamp.hash = hashBytes(readFile(gpioDefsPath));
+    return stamp;
+}
+
+static std::string getChipLabel(const std::string& chipPath)
+{
+    return getGpioBackend().openChip(chipPath)->getInfo().label;
+}
+
+// appends values to the cache image
+class cacheWriter
+{
+  public:
+    template <typename T>
+    void put(T value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        auto bytes = reinterpret_cast<const char*>(&value);
+        data.append(bytes, sizeof(value));
+    }
+
+    void put(const std::string& value)
+    {
+        put(static_cast<uint32_t>(value.size()));
+        data.append(value);
+    }
+
+    const std::string& get() const
+    {
+        return data;
+    }
+
+  private:
+    std::string data;
+};
+
+// reads values back out of a cache image, throwing if it is truncated
+class cacheReader
+{
+  public:
+    explicit cacheReader(std::string&& data) : data(std::move(data)) {}
+
+    template <typename T>
+    T get()
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, take(sizeof(value)), sizeof(value));
+        return value;
+    }
+
+    std::string getString()
+    {
+        auto size = get<uint32_t>();
+        return {take(size), size};
+    }
+
+  private:
+    const char* take(size_t size)
+    {
+        if (data.size() - pos < size)
+        {
+            throw std::runtime_error("truncated");
+        }
+        pos += size;
+        return data.data() + pos - size;
+    }
+
+    std::string data;
+    size_t pos = 0;
+};
+
+// The form factor settings are cached as parsed, including any build time
+// defaults that were filled in
+static void putExtraInfo(cacheWriter& writer, const buttonConfig& config)
+{
+    if (const auto* power = std::get_if<powerButtonConfig>(&config.extraInfo))
+    {
+        writer.put(extraInfoKind::powerButton);
+        writer.put(static_cast<uint32_t>(power->holdThresholds.size()));
+        for (const auto& threshold : power->holdThresholds)
+        {
+            writer.put(static_cast<int64_t>(threshold.time.count()));
+            writer.put(static_cast<uint8_t>(threshold.pressedLong));
+        }
+    }
+    else if (const auto* hostSelector =
+                 std::get_if<hostSelectorConfig>(&config.extraInfo))
+    {
+        writer.put(extraInfoKind::hostSelector);
+        writer.put(static_cast<uint32_t>(hostSelector->positions.size()));
+        for (const auto& [hsPosition, host] : hostSelector->positions)
+        {
+            writer.put(static_cast<uint64_t>(hsPosition));
+            writer.put(static_cast<uint64_t>(host));
+        }
+        writer.put(static_cast<uint64_t>(hostSelector->maxPosition));
+        writer.put(static_cast<int64_t>(hostSelector->settleTime.count()));
+        writer.put(
+            static_cast<int64_t>(hostSelector->minPositionInterval.count()));
+    }
+    else
+    {
+        writer.put(extraInfoKind::none);
+    }
+}
+
+static void getExtraInfo(cacheReader& reader, buttonConfig& config)
+{
+    auto kind = reader.get<extraInfoKind>();
+
+    if (kind == extraInfoKind::powerButton)
+    {
+        auto& power = config.extraInfo.emplace<powerButtonConfig>();
+        auto count = reader.get<uint32_t>();
+        for (uint32_t threshold = 0; threshold < count; threshold++)
+        {
+            auto time = std::chrono::milliseconds(reader.get<int64_t>());
+            auto pressedLong = reader.get<uint8_t>() != 0;
+            power.holdThresholds.push_back({time, pressedLong});
+        }
+    }
+    else if (kind == extraInfoKind::hostSelector)
+    {
+        auto& hostSelector = config.extraInfo.emplace<hostSelectorConfig>();
+        auto count = reader.get<uint32_t>();
+        for (uint32_t position = 0; position < count; position++)
+        {
+            auto hsPosition = reader.get<uint64_t>();
+            auto host = reader.get<uint64_t>();
+            hostSelector.positions.emplace_back(hsPosition, host);
+        }
+        hostSelector.maxPosition = reader.get<uint64_t>();
+        hostSelector.settleTime =
+            std::chrono::milliseconds(reader.get<int64_t>());
+        hostSelector.minPositionInterval =
+            std::chrono::milliseconds(reader.get<int64_t>());
+    }
+    else if (kind != extraInfoKind::none)
+    {
+        throw std::runtime_error("unknown button settings");
+    }
+}
+
+bool loadGpioDefsCache(const std::string& cachePath,
+                       const std::string& gpioDefsPath,
+                       std::vector<buttonConfig>& buttonConfigs)
+{
+    if (!fs::exists(cachePath))
+    {
+        return false;
+    }
+
+    try
+    {
+        cacheReader reader{readFile(cachePath)};
+        if (reader.get<uint32_t>() != cacheMagic ||
+            reader.get<uint32_t>() != cacheVersion)
+        {
+            lg2::info("Ignoring GPIO defs cache with an unknown format");
+            return false;
+        }
+        if (reader.get<uint64_t>() != LONG_PRESS_TIME_MS ||
+            reader.get<uint64_t>() != HOST_SELECTOR_SETTLE_MS)
+        {
+            lg2::info("Ignoring GPIO defs cache with other build defaults");
+            return false;
+        }
+
+        auto stamp = getGpioDefsStamp(gpioDefsPath);
+        if (reader.getString() != gpioDefsPath ||
+            reader.get<uint64_t>() != stamp.size ||
+            reader.get<int64_t>() != stamp.mtime ||
+            reader.get<uint64_t>() != stamp.hash)
+        {
+            lg2::info("GPIO defs changed since they were cached");
+            return false;
+        }
+
+        // gpiochip numbering can change between boots, so make sure each
+        // chip path is still the same controller
+        std::map<std::string, std::unique_ptr<GpioChip>> chips;
+        auto chipCount = reader.get<uint32_t>();
+        for (uint32_t chip = 0; chip < chipCount; chip++)
+        {
+            auto chipPath = reader.getString();
+            auto label = reader.getString();
+            auto& opened =
+                chips.emplace(chipPath, getGpioBackend().openChip(chipPath))
+                    .first->second;
+            if (opened->getInfo().label != label)
+            {
+                lg2::info("{CHIP} is no longer {LABEL}, not using the cache",
+                          "CHIP", chipPath, "LABEL", label);
+                return false;
+            }
+        }
+
+        std::vector<buttonConfig> configs(reader.get<uint32_t>());
+        for (auto& config : configs)
+        {
+            config.formFactorName = reader.getString();
+            getExtraInfo(reader, config);
+
+            auto gpioCount = reader.get<uint32_t>();
+            for (uint32_t gpio = 0; gpio < gpioCount; gpio++)
+            {
+                auto buttonName = reader.getString();
+                auto gpioName = reader.getString();
+                auto chipPath = reader.getString();
+                auto offset = reader.get<uint32_t>();
+                auto rising = reader.get<uint8_t>();
+                auto debounceMs = reader.get<uint32_t>();
+
+                // A driver or device tree change can move the lines of a
+                // chip without changing its label
+                auto chip = chips.find(chipPath);
+                if (chip == chips.end() ||
+                    chip->second->getLineName(offset) != gpioName)
+                {
+                    lg2::info("{NAME} is no longer at {CHIP} line {OFFSET}, "
+                              "not using the cache",
+                              "NAME", gpioName, "CHIP", chipPath, "OFFSET",
+                              offset);
+                    return false;
+                }
+
+                gpioInfo gpioCfg{buttonName, gpioName,
+                                 rising ? "rising" : "falling", debounceMs};
+                gpioCfg.chip = chipPath;
+                gpioCfg.offset = offset;
+                config.gpios.push_back(std::move(gpioCfg));
+            }
+        }
+
+        buttonConfigs = std::move(configs);
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Failed to load the GPIO defs cache {PATH}: {ERROR}",
+                   "PATH", cachePath, "ERROR", e);
+        return false;
+    }
+
+    lg2::info("Loaded {COUNT} buttons from the GPIO defs cache", "COUNT",
+              buttonConfigs.size());
+    return true;
+}
+
+void saveGpioDefsCache(const std::string& cachePath,
+                       const std::string& gpioDefsPath,
+                       const std::vector<buttonConfig>& buttonConfigs)
+{
+    try
+    {
+        cacheWriter writer;
+        writer.put(cacheMagic);
+        writer.put(cacheVersion);
+        writer.put(static_cast<uint64_t>(LONG_PRESS_TIME_MS));
+        writer.put(static_cast<uint64_t>(HOST_SELECTOR_SETTLE_MS));
+
+        auto stamp = getGpioDefsStamp(gpioDefsPath);
+        writer.put(gpioDefsPath);
+        writer.put(stamp.size);
+        writer.put(stamp.mtime);
+        writer.put(stamp.hash);
+
+        std::map<std::string, std::string> chipLabels;
+        for (const auto& config : buttonConfigs)
+        {
+            for (const auto& gpio : config.gpios)
+            {
+                if (!chipLabels.contains(gpio.chip))
+                {
+                    chipLabels[gpio.chip] = getChipLabel(gpio.chip);
+                }
+            }
+        }
+        writer.put(static_cast<uint32_t>(chipLabels.size()));
+        for (const auto& [chipPath, label] : chipLabels)
+        {
+            writer.put(chipPath);
+            writer.put(label);
+        }
+
+        writer.put(static_cast<uint32_t>(buttonConfigs.size()));
+        for (const auto& config : buttonConfigs)
+        {
+            writer.put(config.formFactorName);
+            putExtraInfo(writer, config);
+
+            writer.put(static_cast<uint32_t>(config.gpios.size()));
+            for (const auto& gpio : config.gpios)
+            {
+                writer.put(gpio.button_name);
+                writer.put(gpio.gpio_name);
+                writer.put(gpio.chip);
+                writer.put(static_cast<uint32_t>(gpio.offset));
+                writer.put(static_cast<uint8_t>(
+                    gpio.direction ==
+                    gpiod::edge_event::event_type::RISING_EDGE));
+                writer.put(static_cast<uint32_t>(gpio.debounceTime.count()));
+            }
+        }
+
+        // Write a new file and rename it over the old one, so a crash
+        // never leaves a partial cache behind
+        fs::create_directories(fs::path(cachePath).parent_path());
+        std::string tmpPath = cachePath + ".tmp";
+        {
+            std::ofstream file{tmpPath, std::ios::binary | std::ios::trunc};
+            file.write(writer.get().data(), writer.get().size());
+            if (!file)
+            {
+                throw std::runtime_error("Failed to write " + tmpPath);
+            }
+        }
+        fs::rename(tmpPath, cachePath);
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Failed to save the GPIO defs cache {PATH}: {ERROR}",
+                   "PATH", cachePath, "ERROR", e);
+        return;
+    }
+
+    lg2::info("Saved the GPIO defs cache {PATH}", "PATH", cachePath);
+}
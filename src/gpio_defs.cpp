@@ -0,0 +1,629 @@
+#include "gpio_defs.hpp"
+
+#include "button_factory.hpp"
+
+#include <nlohmann/json.hpp>
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <optional>
+
+using json = nlohmann::json;
+
+// reads the file for the parser a buffer at a time, counting the lines it
+// has read, so the whole text is never held in memory
+class lineCountingIterator
+{
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = char;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = char;
+
+    // the end of the file
+    lineCountingIterator() = default;
+    lineCountingIterator(std::istream& stream, size_t* line) :
+        pos(stream), line(line)
+    {}
+
+    reference operator*() const
+    {
+        return *pos;
+    }
+
+    lineCountingIterator& operator++()
+    {
+        if (*pos == '\n')
+        {
+            (*line)++;
+        }
+        ++pos;
+        return *this;
+    }
+
+    lineCountingIterator operator++(int)
+    {
+        auto old = *this;
+        ++*this;
+        return old;
+    }
+
+    bool operator==(const lineCountingIterator& other) const
+    {
+        return pos == other.pos;
+    }
+
+  private:
+    std::istreambuf_iterator<char> pos;
+    size_t* line = nullptr;
+};
+
+// the keys a gpio_definitions entry and a group_gpio_config item share
+struct gpioFields
+{
+    size_t line = 0;
+    std::optional<std::string> name;
+    std::optional<std::string> gpioName;
+    std::optional<std::string> direction;
+    unsigned int debounceMs = 0;
+};
+
+// a gpio_definitions entry while it is being read
+struct pendingEntry
+{
+    gpioFields fields;
+    bool hasGroup = false;
+    std::vector<gpioInfo> groupGpios;
+    // the form factor's own settings and the line each one is on
+    json settings = json::object();
+    std::map<std::string, size_t> settingLines;
+    bool unsupported = false;
+    bool failed = false;
+};
+
+static bool hasType(const json& value, configValueType type)
+{
+    switch (type)
+    {
+        case configValueType::string:
+            return value.is_string();
+        case configValueType::unsignedInteger:
+            return value.is_number_unsigned();
+        case configValueType::array:
+            return value.is_array();
+        case configValueType::object:
+            return value.is_object();
+    }
+    return false;
+}
+
+static const char* getTypeName(configValueType type)
+{
+    switch (type)
+    {
+        case configValueType::string:
+            return "must be a string";
+        case configValueType::unsignedInteger:
+            return "must be an unsigned integer";
+        case configValueType::array:
+            return "must be an array";
+        case configValueType::object:
+            return "must be an object";
+    }
+    return "has the wrong type";
+}
+
+/**
+ * @class gpioDefsParser
+ *
+ * Takes the SAX events for a gpio defs file and builds the button configs
+ * from them. Only the settings a form factor declares in its configKeys
+ * are kept as json, to be handed to its parseConfig(). Everything else is
+ * read into the configs directly or skipped over.
+ */
+class gpioDefsParser
+{
+  public:
+    gpioDefsParser(const std::string& path, const size_t& line,
+                   std::vector<buttonConfig>& buttonConfigs) :
+        path(path),
+        line(line), buttonConfigs(buttonConfigs)
+    {}
+
+    bool null()
+    {
+        return value(json(nullptr));
+    }
+    bool boolean(bool val)
+    {
+        return value(json(val));
+    }
+    bool number_integer(json::number_integer_t val)
+    {
+        return value(json(val));
+    }
+    bool number_unsigned(json::number_unsigned_t val)
+    {
+        return value(json(val));
+    }
+    bool number_float(json::number_float_t val, const json::string_t&)
+    {
+        return value(json(val));
+    }
+    bool string(json::string_t& val)
+    {
+        return value(json(std::move(val)));
+    }
+    bool binary(json::binary_t&)
+    {
+        return value(json());
+    }
+    bool start_object(size_t)
+    {
+        return startContainer(true);
+    }
+    bool start_array(size_t)
+    {
+        return startContainer(false);
+    }
+    bool end_object()
+    {
+        return endContainer();
+    }
+    bool end_array()
+    {
+        return endContainer();
+    }
+
+    bool key(json::string_t& name)
+    {
+        if (!frames.empty() && frames.back() == frame::setting)
+        {
+            settingKey = name;
+        }
+        else
+        {
+            currentKey = name;
+        }
+        return true;
+    }
+
+    bool parse_error(size_t, const std::string&,
+                     const nlohmann::detail::exception& e)
+    {
+        lg2::error("{FILE}:{LINE}: {ERROR}", "FILE", path, "LINE", line,
+                   "ERROR", e.what());
+        return false;
+    }
+
+    bool foundDefinitions() const
+    {
+        return definitionsFound;
+    }
+
+    int getErrors() const
+    {
+        return errors;
+    }
+
+  private:
+    // what the json being read belongs to
+    enum class frame
+    {
+        root,
+        definitions, // the gpio_definitions array
+        entry,       // an object in gpio_definitions
+        group,       // the group_gpio_config array of an entry
+        groupEntry,  // an object in group_gpio_config
+        setting,     // a container in one of the form factor's settings
+        skip         // a container that isn't used
+    };
+
+    bool fileError(const std::string& message)
+    {
+        lg2::error("{FILE}:{LINE}: {ERROR}", "FILE", path, "LINE", line,
+                   "ERROR", message);
+        return false;
+    }
+
+    void entryError(const std::string& key, const std::string& message,
+                    size_t errorLine)
+    {
+        lg2::error("{FILE}:{LINE}: {KEY}: {ERROR}", "FILE", path, "LINE",
+                   errorLine, "KEY", key, "ERROR", message);
+        entry.failed = true;
+    }
+
+    void entryError(const std::string& key, const std::string& message)
+    {
+        entryError(key, message, line);
+    }
+
+    // whether an entry setting is worth keeping, which can only be known
+    // once the form factor name has been read
+    bool isSettingWanted(const std::string& key) const
+    {
+        if (!entry.fields.name)
+        {
+            return true;
+        }
+        const auto& keys =
+            ButtonFactory::instance().getConfigKeys(*entry.fields.name);
+        return std::any_of(keys.begin(), keys.end(), [&key](const auto& k) {
+            return k.name == key;
+        });
+    }
+
+    // reads one of the keys entries and group items share, returning
+    // false if the current key isn't one of them
+    bool setField(gpioFields& fields, const json& val)
+    {
+        if (currentKey == "name" || currentKey == "gpio_name" ||
+            currentKey == "direction")
+        {
+            if (!val.is_string())
+            {
+                entryError(currentKey, "must be a string");
+                return true;
+            }
+            auto& field = (currentKey == "name")        ? fields.name
+                          : (currentKey == "gpio_name") ? fields.gpioName
+                                                        : fields.direction;
+            field = val.get<std::string>();
+            return true;
+        }
+        if (currentKey == "debounce_ms")
+        {
+            if (!val.is_number_unsigned())
+            {
+                entryError(currentKey, "must be an unsigned integer");
+                return true;
+            }
+            fields.debounceMs = val.get<unsigned int>();
+            return true;
+        }
+        return false;
+    }
+
+    bool isFieldKey() const
+    {
+        return currentKey == "name" || currentKey == "gpio_name" ||
+               currentKey == "direction" || currentKey == "debounce_ms";
+    }
+
+    // adds a value to the setting being built and returns where it went
+    json& addSetting(json&& val)
+    {
+        auto& container = *settingStack.back();
+        if (container.is_array())
+        {
+            container.push_back(std::move(val));
+            return container.back();
+        }
+        container[settingKey] = std::move(val);
+        return container[settingKey];
+    }
+
+    bool value(json&& val)
+    {
+        if (frames.empty())
+        {
+            return fileError("the gpio defs must be an object");
+        }
+
+        switch (frames.back())
+        {
+            case frame::root:
+                if (currentKey == "gpio_definitions")
+                {
+                    return fileError("gpio_definitions must be an array");
+                }
+                break;
+            case frame::definitions:
+                lg2::error("{FILE}:{LINE}: gpio_definitions entries must be "
+                           "objects",
+                           "FILE", path, "LINE", line);
+                errors++;
+                break;
+            case frame::entry:
+                if (entry.unsupported)
+                {
+                    break;
+                }
+                if (setField(entry.fields, val))
+                {
+                    // Skip the rest of an entry nothing here uses
+                    if (currentKey == "name" && entry.fields.name &&
+                        !ButtonFactory::instance().isSupported(
+                            *entry.fields.name))
+                    {
+                        entry.unsupported = true;
+                        entry.settings = json::object();
+                        entry.settingLines.clear();
+                    }
+                    break;
+                }
+                if (currentKey == "group_gpio_config")
+                {
+                    entryError(currentKey, "must be an array");
+                }
+                else if (isSettingWanted(currentKey))
+                {
+                    entry.settings[currentKey] = std::move(val);
+                    entry.settingLines[currentKey] = line;
+                }
+                break;
+            case frame::group:
+                entryError("group_gpio_config", "items must be objects");
+                break;
+            case frame::groupEntry:
+                setField(groupGpio, val);
+                break;
+            case frame::setting:
+                addSetting(std::move(val));
+                break;
+            case frame::skip:
+                break;
+        }
+        return true;
+    }
+
+    bool startContainer(bool isObject)
+    {
+        if (frames.empty())
+        {
+            if (!isObject)
+            {
+                return fileError("the gpio defs must be an object");
+            }
+            frames.push_back(frame::root);
+            return true;
+        }
+
+        auto next = frame::skip;
+        switch (frames.back())
+        {
+            case frame::root:
+                if (currentKey == "gpio_definitions")
+                {
+                    if (isObject)
+                    {
+                        return fileError("gpio_definitions must be an array");
+                    }
+                    definitionsFound = true;
+                    next = frame::definitions;
+                }
+                break;
+            case frame::definitions:
+                if (!isObject)
+                {
+                    lg2::error("{FILE}:{LINE}: gpio_definitions entries must "
+                               "be objects",
+                               "FILE", path, "LINE", line);
+                    errors++;
+                    break;
+                }
+                entry = pendingEntry{};
+                entry.fields.line = line;
+                next = frame::entry;
+                break;
+            case frame::entry:
+                if (entry.unsupported)
+                {
+                    break;
+                }
+                if (currentKey == "group_gpio_config")
+                {
+                    if (isObject)
+                    {
+                        entryError(currentKey, "must be an array");
+                        break;
+                    }
+                    entry.hasGroup = true;
+                    next = frame::group;
+                }
+                else if (isFieldKey())
+                {
+                    entryError(currentKey, currentKey == "debounce_ms"
+                                               ? "must be an unsigned integer"
+                                               : "must be a string");
+                }
+                else if (isSettingWanted(currentKey))
+                {
+                    auto& setting = entry.settings[currentKey];
+                    setting = isObject ? json::object() : json::array();
+                    entry.settingLines[currentKey] = line;
+                    settingStack = {&setting};
+                    next = frame::setting;
+                }
+                break;
+            case frame::group:
+                if (!isObject)
+                {
+                    entryError("group_gpio_config", "items must be objects");
+                    break;
+                }
+                groupGpio = gpioFields{};
+                groupGpio.line = line;
+                next = frame::groupEntry;
+                break;
+            case frame::groupEntry:
+                if (isFieldKey())
+                {
+                    entryError(currentKey, currentKey == "debounce_ms"
+                                               ? "must be an unsigned integer"
+                                               : "must be a string");
+                }
+                break;
+            case frame::setting:
+                settingStack.push_back(
+                    &addSetting(isObject ? json::object() : json::array()));
+                next = frame::setting;
+                break;
+            case frame::skip:
+                break;
+        }
+        frames.push_back(next);
+        return true;
+    }
+
+    bool endContainer()
+    {
+        auto ended = frames.back();
+        frames.pop_back();
+
+        switch (ended)
+        {
+            case frame::entry:
+                finishEntry();
+                break;
+            case frame::groupEntry:
+                finishGroupGpio();
+                break;
+            case frame::setting:
+                settingStack.pop_back();
+                break;
+            default:
+                break;
+        }
+        return true;
+    }
+
+    void finishGroupGpio()
+    {
+        if (!groupGpio.name || !groupGpio.gpioName || !groupGpio.direction)
+        {
+            entryError("group_gpio_config",
+                       "items need a name, gpio_name and direction",
+                       groupGpio.line);
+            return;
+        }
+        entry.groupGpios.emplace_back(*groupGpio.name, *groupGpio.gpioName,
+                                      *groupGpio.direction,
+                                      groupGpio.debounceMs);
+    }
+
+    void finishEntry()
+    {
+        /* There are additional gpio configs present in some platforms
+         that are not supported in phosphor-buttons.
+        But they may be used by other applications. so skipping such configs
+        if present in gpio_defs.json file*/
+        if (entry.unsupported)
+        {
+            return;
+        }
+
+        auto& fields = entry.fields;
+        if (!fields.name)
+        {
+            entryError("name", "missing", fields.line);
+        }
+        else if (!entry.hasGroup && (!fields.gpioName || !fields.direction))
+        {
+            entryError(fields.gpioName ? "direction" : "gpio_name", "missing",
+                       fields.line);
+        }
+        if (entry.failed)
+        {
+            errors++;
+            return;
+        }
+
+        // Check the settings against the ones the form factor declares
+        for (const auto& key :
+             ButtonFactory::instance().getConfigKeys(*fields.name))
+        {
+            std::string name{key.name};
+            if (!entry.settings.contains(name))
+            {
+                if (key.required)
+                {
+                    entryError(name, "missing", fields.line);
+                }
+                continue;
+            }
+            if (!hasType(entry.settings[name], key.type))
+            {
+                entryError(name, getTypeName(key.type),
+                           entry.settingLines[name]);
+            }
+        }
+        if (entry.failed)
+        {
+            errors++;
+            return;
+        }
+
+        buttonConfig buttonCfg;
+        buttonCfg.formFactorName = *fields.name;
+        if (entry.hasGroup)
+        {
+            buttonCfg.gpios = std::move(entry.groupGpios);
+        }
+        else
+        {
+            buttonCfg.gpios.emplace_back(*fields.name, *fields.gpioName,
+                                         *fields.direction, fields.debounceMs);
+        }
+
+        try
+        {
+            ButtonFactory::instance().parseConfig(*fields.name,
+                                                  entry.settings, buttonCfg);
+        }
+        catch (const std::exception& e)
+        {
+            entryError(*fields.name, e.what(), fields.line);
+            errors++;
+            return;
+        }
+        buttonConfigs.push_back(std::move(buttonCfg));
+    }
+
+    const std::string& path;
+    const size_t& line;
+    std::vector<buttonConfig>& buttonConfigs;
+
+    std::vector<frame> frames;
+    std::string currentKey;
+    bool definitionsFound = false;
+    int errors = 0;
+
+    pendingEntry entry;
+    gpioFields groupGpio;
+    // the containers of the setting being built, innermost last
+    std::vector<json*> settingStack;
+    std::string settingKey;
+};
+
+int loadGpioDefs(const std::string& gpioDefsPath,
+                 std::vector<buttonConfig>& buttonConfigs)
+{
+    std::ifstream file{gpioDefsPath, std::ios::binary};
+    if (!file)
+    {
+        lg2::error("Failed to open {FILE}", "FILE", gpioDefsPath);
+        return -1;
+    }
+
+    size_t line = 1;
+    gpioDefsParser parser{gpioDefsPath, line, buttonConfigs};
+    lineCountingIterator begin{file, &line};
+    lineCountingIterator end;
+    if (!json::sax_parse(begin, end, &parser))
+    {
+        buttonConfigs.clear();
+        return -1;
+    }
+    if (!parser.foundDefinitions())
+    {
+        lg2::error("{FILE}: no gpio_definitions", "FILE", gpioDefsPath);
+        return -1;
+    }
+    return parser.getErrors();
+}
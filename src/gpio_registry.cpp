@@ -0,0 +1,932 @@
+#include "gpio_registry.hpp"
+
+#include "latency.hpp"
+
+#include <boost/asio/steady_timer.hpp>
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <tuple>
+
+constexpr auto gpioRegistryIface =
+    "xyz.openbmc_project.Chassis.Buttons.Debug.Gpios";
+
+// A chip whose request failed is tried again after retryDelayFirst, with
+// the wait doubling after each failed try up to retryDelayMax
+constexpr auto retryDelayFirst = std::chrono::milliseconds(100);
+constexpr auto retryDelayMax = std::chrono::milliseconds(30000);
+// The wait only starts from retryDelayFirst again once the chip has stayed
+// in service this long, so a chip that fails right after each retry
+// still backs off
+constexpr auto retryResetTime = std::chrono::seconds(60);
+
+// Passes an edge on to the button. With debouncing configured the edge is
+// held back until the line has been stable for debounceTime, and edges that
+// bounce back to the last reported state are dropped.
+static void dispatchGPIOEvent(gpioInfo& gpioConfig, bool asserted,
+                              gpioEventTime timestamp)
+{
+    if (!gpioConfig.debounceTimer)
+    {
+        phosphor::button::latency::record(
+            phosphor::button::latency::Stage::edgeToDispatch, timestamp);
+        gpioConfig.reportedAsserted = asserted;
+        gpioConfig.handler(gpioConfig.userdata,
+                           gpioEvent{gpioConfig.index, asserted, timestamp});
+        return;
+    }
+
+    gpioConfig.pendingAsserted = asserted;
+    gpioConfig.pendingTime = timestamp;
+    // Re-arming aborts the wait for the edge this one supersedes
+    gpioConfig.stats.debounced +=
+        gpioConfig.debounceTimer->expires_after(gpioConfig.debounceTime);
+    gpioConfig.debounceTimer->async_wait(
+        [&gpioConfig](const boost::system::error_code ec) {
+        if (ec)
+        {
+            return;
+        }
+        if (gpioConfig.pendingAsserted == gpioConfig.reportedAsserted)
+        {
+            gpioConfig.stats.debounced++;
+            return;
+        }
+        gpioConfig.reportedAsserted = gpioConfig.pendingAsserted;
+        phosphor::button::latency::record(
+            phosphor::button::latency::Stage::edgeToDispatch,
+            gpioConfig.pendingTime);
+        gpioConfig.handler(gpioConfig.userdata,
+                           gpioEvent{gpioConfig.index,
+                                     gpioConfig.reportedAsserted,
+                                     gpioConfig.pendingTime});
+    });
+}
+
+static std::unique_ptr<GpioLineRequest>
+    requestChipLines(const std::string& chipPath,
+                     std::vector<gpioInfo*>& gpios, bool kernelDebounce)
+{
+    std::vector<gpioLineSettings> lines;
+    for (auto* gpio : gpios)
+    {
+        lines.push_back(gpioLineSettings{
+            gpio->offset, kernelDebounce ? gpio->debounceTime
+                                         : std::chrono::milliseconds(0)});
+        gpio->kernelDebounce = kernelDebounce &&
+                               gpio->debounceTime.count() > 0;
+    }
+
+    return getGpioBackend().openChip(chipPath)->requestLines(lines);
+}
+
+// Groups the resolved gpios by chip, returning -1 if any wasn't found
+static int groupGpiosByChip(
+    std::vector<buttonConfig>& buttonConfigs,
+    std::map<std::string, std::vector<gpioInfo*>>& gpiosByChip)
+{
+    int result = 0;
+    for (auto& buttonCfg : buttonConfigs)
+    {
+        for (auto& gpioCfg : buttonCfg.gpios)
+        {
+            if (gpioCfg.chip.empty())
+            {
+                std::string errMsg = "Failed to find the " +
+                                     gpioCfg.gpio_name + " line for " +
+                                     gpioCfg.button_name;
+                lg2::error(errMsg.c_str());
+                result = -1;
+                continue;
+            }
+            gpiosByChip[gpioCfg.chip].push_back(&gpioCfg);
+        }
+    }
+    return result;
+}
+
+// Picks the debouncing of a gpio again once its chip has a new request,
+// which may have taken a debounce period the old one turned down or the
+// other way around
+static void updateDebounce(gpioInfo& gpioConfig, boost::asio::io_service& io)
+{
+    if (gpioConfig.kernelDebounce)
+    {
+        gpioConfig.debounceTimer.reset();
+    }
+    else if (gpioConfig.debounceTime.count() > 0 && !gpioConfig.debounceTimer)
+    {
+        gpioConfig.debounceTimer =
+            std::make_shared<boost::asio::steady_timer>(io);
+    }
+    gpioConfig.lastSeqno = 0;
+}
+
+GpioRegistry::handle GpioRegistry::addLine(chipRequest& chip,
+                                           unsigned int offset)
+{
+    handle lineHandle;
+    if (!freeHandles.empty())
+    {
+        lineHandle = freeHandles.back();
+        freeHandles.pop_back();
+    }
+    else
+    {
+        lineHandle = static_cast<handle>(lines.size());
+        lines.emplace_back();
+    }
+
+    lines[lineHandle] = lineEntry{&chip, offset, nullptr};
+    if (chip.handles.size() <= offset)
+    {
+        chip.handles.resize(offset + 1, noHandle);
+    }
+    chip.handles[offset] = lineHandle;
+    return lineHandle;
+}
+
+void GpioRegistry::freeLine(handle lineHandle)
+{
+    auto& line = lines[lineHandle];
+    line.chip->handles[line.offset] = noHandle;
+    if (line.gpio)
+    {
+        line.gpio->handle = noHandle;
+    }
+    line = lineEntry{};
+    freeHandles.push_back(lineHandle);
+}
+
+void GpioRegistry::releaseRequest(chipRequest& chip)
+{
+    if (chip.streamDesc)
+    {
+        // The fd belongs to the line request, so don't let asio close it
+        chip.streamDesc->cancel();
+        chip.streamDesc->release();
+        chip.streamDesc.reset();
+    }
+    chip.request.reset();
+}
+
+void GpioRegistry::releaseChip(chipRequest& chip)
+{
+    releaseRequest(chip);
+    for (auto lineHandle : chip.handles)
+    {
+        if (lineHandle != noHandle)
+        {
+            freeLine(lineHandle);
+        }
+    }
+    auto path = chip.path;
+    chips.erase(path);
+    updateDegraded();
+}
+
+void GpioRegistry::releaseAll()
+{
+    if (chips.empty())
+    {
+        return;
+    }
+
+    // Release the requests and forget all the handles in one pass
+    lg2::info("Closing all button gpio lines.");
+    for (auto& [path, chip] : chips)
+    {
+        releaseRequest(*chip);
+    }
+    for (auto& line : lines)
+    {
+        if (line.gpio)
+        {
+            line.gpio->handle = noHandle;
+        }
+    }
+    lines.clear();
+    freeHandles.clear();
+    chips.clear();
+    updateDegraded();
+}
+
+void GpioRegistry::updateDegraded()
+{
+    bool isDegraded = std::any_of(chips.begin(), chips.end(),
+                                  [](const auto& chip) {
+        return !chip.second->request;
+    });
+    if (isDegraded == degraded)
+    {
+        return;
+    }
+
+    degraded = isDegraded;
+    if (degraded)
+    {
+        lg2::warning("Some button gpios are out of service");
+    }
+    else
+    {
+        lg2::info("All button gpios are back in service");
+    }
+    if (auto iface = debugIface.lock())
+    {
+        iface->set_property("Degraded", degraded);
+    }
+}
+
+// Takes a chip whose request failed out of service. Its lines stay bound,
+// so their buttons get events again once a retry has requested it.
+void GpioRegistry::faultChip(chipRequest& chip)
+{
+    releaseRequest(chip);
+    chip.faults++;
+    for (auto lineHandle : chip.handles)
+    {
+        if (lineHandle != noHandle && lines[lineHandle].gpio)
+        {
+            lines[lineHandle].gpio->stats.faults++;
+        }
+    }
+
+    chip.retryDelay = chip.retryDelay.count() > 0
+                          ? std::min(chip.retryDelay * 2, retryDelayMax)
+                          : retryDelayFirst;
+    lg2::error("{CHIP} is out of service, retrying in {DELAY} ms", "CHIP",
+               chip.path, "DELAY", chip.retryDelay.count());
+    scheduleRetry(chip);
+    updateDegraded();
+}
+
+void GpioRegistry::scheduleRetry(chipRequest& chip)
+{
+    if (!chip.retryTimer)
+    {
+        chip.retryTimer = std::make_unique<boost::asio::steady_timer>(io);
+    }
+    chip.retryTimer->expires_after(chip.retryDelay);
+    chip.retryTimer->async_wait(
+        [this, weakChip = chip.weak_from_this()](
+            const boost::system::error_code ec) {
+        // The chip may have been released, or requested again, after the
+        // timer fired but before this ran
+        auto chip = weakChip.lock();
+        if (ec || !chip || chip->request)
+        {
+            return;
+        }
+        retryChip(*chip);
+    });
+}
+
+void GpioRegistry::retryChip(chipRequest& chip)
+{
+    // Only the bound lines have a gpio config to request them with
+    std::vector<gpioInfo*> gpios;
+    for (auto lineHandle : chip.handles)
+    {
+        if (lineHandle == noHandle)
+        {
+            continue;
+        }
+        if (lines[lineHandle].gpio)
+        {
+            gpios.push_back(lines[lineHandle].gpio);
+        }
+        else
+        {
+            freeLine(lineHandle);
+        }
+    }
+    if (gpios.empty())
+    {
+        releaseChip(chip);
+        return;
+    }
+
+    if (!openChip(chip, gpios))
+    {
+        chip.retryDelay = std::min(chip.retryDelay * 2, retryDelayMax);
+        lg2::error("Retrying {CHIP} in {DELAY} ms", "CHIP", chip.path,
+                   "DELAY", chip.retryDelay.count());
+        scheduleRetry(chip);
+        return;
+    }
+
+    for (auto* gpio : gpios)
+    {
+        updateDebounce(*gpio, io);
+        gpio->stats.recoveries++;
+    }
+    chip.recoveries++;
+    lg2::info("{CHIP} is back in service with {COUNT} button GPIOs", "CHIP",
+              chip.path, "COUNT", gpios.size());
+    scheduleRetryReset(chip);
+    updateDegraded();
+    resyncLines(gpios);
+}
+
+void GpioRegistry::scheduleRetryReset(chipRequest& chip)
+{
+    // Another fault re-arms the timer for its retry, which cancels this
+    chip.retryTimer->expires_after(retryResetTime);
+    chip.retryTimer->async_wait(
+        [weakChip = chip.weak_from_this()](
+            const boost::system::error_code ec) {
+        auto chip = weakChip.lock();
+        if (ec || !chip || !chip->request)
+        {
+            return;
+        }
+        chip->retryDelay = std::chrono::milliseconds(0);
+    });
+}
+
+void GpioRegistry::waitForEvent(chipRequest& chip)
+{
+    // This is an async function that is called upon a change
+    // to any of the gpios of the chip request
+    chip.streamDesc->async_wait(
+        boost::asio::posix::stream_descriptor::wait_read,
+        [this, weakChip = chip.weak_from_this(),
+         streamDesc = chip.streamDesc](const boost::system::error_code ec) {
+        // The request may have been released, and the chip with it, after
+        // the fd became readable but before this ran
+        auto chipPtr = weakChip.lock();
+        if (ec == boost::asio::error::operation_aborted || !chipPtr ||
+            chipPtr->streamDesc != streamDesc)
+        {
+            return;
+        }
+        auto& chip = *chipPtr;
+        if (ec)
+        {
+            lg2::error("{CHIP} fd handler error: {ERROR}", "CHIP", chip.path,
+                       "ERROR", ec.message());
+            faultChip(chip);
+            return;
+        }
+
+        // Drain everything queued since the last wakeup, in order,
+        // before going back to the event loop. A failed read only takes
+        // this chip out of service.
+        size_t count = 0;
+        bool more = true;
+        while (more)
+        {
+            try
+            {
+                count += chip.request->readEdges(chip.eventBuffer);
+            }
+            catch (const std::exception& e)
+            {
+                lg2::error("Failed to read the {CHIP} events: {ERROR}",
+                           "CHIP", chip.path, "ERROR", e);
+                faultChip(chip);
+                return;
+            }
+
+            for (const auto& edge : chip.eventBuffer)
+            {
+                auto offset = edge.offset;
+                auto lineHandle = offset < chip.handles.size()
+                                      ? chip.handles[offset]
+                                      : noHandle;
+                if (lineHandle == noHandle || !lines[lineHandle].gpio)
+                {
+                    // Not bound to a button (yet)
+                    continue;
+                }
+                gpioInfo& gpioConfig = *lines[lineHandle].gpio;
+                if (!gpioConfig.userdata || !gpioConfig.handler)
+                {
+                    lg2::error("Failed to find the {NAME} userdata or handler",
+                               "NAME", gpioConfig.button_name);
+                    continue;
+                }
+
+                // A gap in the per line sequence numbers means the kernel
+                // queue overflowed and dropped events
+                auto seqno = edge.seqno;
+                if (gpioConfig.lastSeqno != 0 &&
+                    seqno > gpioConfig.lastSeqno + 1)
+                {
+                    gpioConfig.stats.overflows++;
+                    gpioConfig.stats.dropped += seqno - gpioConfig.lastSeqno -
+                                                1;
+                    lg2::warning(
+                        "{NAME} event queue overflowed, {DROPPED} edges dropped so far",
+                        "NAME", gpioConfig.button_name, "DROPPED",
+                        gpioConfig.stats.dropped);
+                }
+                gpioConfig.lastSeqno = seqno;
+                gpioConfig.stats.events++;
+
+                bool asserted =
+                    edge.rising == (gpioConfig.direction ==
+                                    gpiod::edge_event::event_type::RISING_EDGE);
+                dispatchGPIOEvent(gpioConfig, asserted, edge.timestamp);
+                if (chip.streamDesc != streamDesc)
+                {
+                    // The button released the request, so the rest of the
+                    // buffer is stale
+                    return;
+                }
+            }
+
+            try
+            {
+                more = chip.request->waitEdges(std::chrono::nanoseconds(0));
+            }
+            catch (const std::exception& e)
+            {
+                lg2::error("Failed to wait for the {CHIP} events: {ERROR}",
+                           "CHIP", chip.path, "ERROR", e);
+                faultChip(chip);
+                return;
+            }
+        }
+
+        chip.wakeups++;
+        chip.maxEventsPerWakeup = std::max(chip.maxEventsPerWakeup, count);
+        lg2::debug("{CHIP}: {COUNT} events this wakeup, {WAKEUPS} wakeups",
+                   "CHIP", chip.path, "COUNT", count, "WAKEUPS",
+                   chip.wakeups);
+        waitForEvent(chip);
+    });
+}
+
+// Requests the given lines of the chip and starts waiting for their events
+bool GpioRegistry::openChip(chipRequest& chip, std::vector<gpioInfo*>& gpios)
+{
+    try
+    {
+        try
+        {
+            chip.request = requestChipLines(chip.path, gpios, true);
+        }
+        catch (const std::exception& e)
+        {
+            // Retry with the debounce periods left to the event loop
+            lg2::info("Requesting {CHIP} without debounce: {ERROR}", "CHIP",
+                      chip.path, "ERROR", e);
+            chip.request = requestChipLines(chip.path, gpios, false);
+        }
+
+        // Assign the request fd to this stream descriptor
+        chip.streamDesc =
+            std::make_shared<boost::asio::posix::stream_descriptor>(io);
+        chip.streamDesc->assign(chip.request->fd());
+    }
+    catch (const std::exception& e)
+    {
+        releaseRequest(chip);
+        lg2::error("Failed to request events for {CHIP}: {ERROR}", "CHIP",
+                   chip.path, "ERROR", e);
+        return false;
+    }
+
+    waitForEvent(chip);
+    return true;
+}
+
+// Adds a request for the given lines of a chip. Lines that are still bound
+// keep their handles, the others get new ones. A chip that can't be
+// requested is kept out of service and retried, so returns false.
+bool GpioRegistry::requestChip(const std::string& chipPath,
+                               std::vector<gpioInfo*>& gpios)
+{
+    auto& chip = chips[chipPath];
+    chip = std::make_shared<chipRequest>(chipPath);
+
+    for (auto* gpio : gpios)
+    {
+        if (gpio->handle < lines.size() && lines[gpio->handle].gpio == gpio)
+        {
+            lines[gpio->handle].chip = chip.get();
+            if (chip->handles.size() <= gpio->offset)
+            {
+                chip->handles.resize(gpio->offset + 1, noHandle);
+            }
+            chip->handles[gpio->offset] = gpio->handle;
+            chip->boundLines++;
+            continue;
+        }
+        gpio->handle = addLine(*chip, gpio->offset);
+        gpio->registry = this;
+    }
+
+    if (!openChip(*chip, gpios))
+    {
+        faultChip(*chip);
+        return false;
+    }
+
+    lg2::info("Requested {COUNT} button GPIOs on {CHIP}", "COUNT",
+              gpios.size(), "CHIP", chipPath);
+    return true;
+}
+
+int GpioRegistry::requestGpios(std::vector<buttonConfig>& buttonConfigs)
+{
+    resolveGpios(buttonConfigs);
+
+    // Group the lines by chip
+    std::map<std::string, std::vector<gpioInfo*>> gpiosByChip;
+    int result = groupGpiosByChip(buttonConfigs, gpiosByChip);
+
+    for (auto& [chipPath, gpios] : gpiosByChip)
+    {
+        if (!requestChip(chipPath, gpios))
+        {
+            result = -1;
+        }
+    }
+
+    return result;
+}
+
+int GpioRegistry::reloadGpios(std::vector<buttonConfig>& buttonConfigs)
+{
+    resolveGpios(buttonConfigs);
+
+    // The chips the new buttons have lines on
+    std::map<std::string, std::vector<gpioInfo*>> gpiosByChip;
+    int result = groupGpiosByChip(buttonConfigs, gpiosByChip);
+
+    // and the chips still requesting lines of buttons that are gone, or out
+    // of service, which are tried again now
+    for (const auto& [chipPath, chip] : chips)
+    {
+        if (!chip->request || chip->request->numLines() != chip->boundLines)
+        {
+            gpiosByChip[chipPath];
+        }
+    }
+
+    for (auto& [chipPath, gpios] : gpiosByChip)
+    {
+        // Nothing is read from the chip until it has been requested again
+        auto start = std::chrono::steady_clock::now();
+
+        // The lines still bound keep their handles, and the others are
+        // dropped with the old request
+        std::vector<gpioInfo*> bound;
+        auto oldChip = chips.find(chipPath);
+        if (oldChip != chips.end())
+        {
+            auto& chip = *oldChip->second;
+            releaseRequest(chip);
+            for (auto lineHandle : chip.handles)
+            {
+                if (lineHandle == noHandle)
+                {
+                    continue;
+                }
+                if (lines[lineHandle].gpio)
+                {
+                    bound.push_back(lines[lineHandle].gpio);
+                    lines[lineHandle].chip = nullptr;
+                }
+                else
+                {
+                    freeLine(lineHandle);
+                }
+            }
+            chips.erase(oldChip);
+        }
+
+        gpios.insert(gpios.end(), bound.begin(), bound.end());
+        if (gpios.empty())
+        {
+            lg2::info("Released the button GPIOs on {CHIP}", "CHIP",
+                      chipPath);
+            continue;
+        }
+        if (!requestChip(chipPath, gpios))
+        {
+            result = -1;
+            continue;
+        }
+
+        // The buttons already using the chip carry on with the new request
+        for (auto* gpio : bound)
+        {
+            updateDebounce(*gpio, io);
+        }
+        resyncLines(bound);
+
+        auto blackout = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+        lg2::info("Requested {CHIP} again, {KEPT} lines kept and no events "
+                  "read for {TIME} us",
+                  "CHIP", chipPath, "KEPT", bound.size(), "TIME",
+                  blackout.count());
+    }
+    updateDegraded();
+
+    return result;
+}
+
+void GpioRegistry::releaseGpios(
+    const std::vector<buttonConfig>& buttonConfigs)
+{
+    for (const auto& buttonCfg : buttonConfigs)
+    {
+        for (const auto& gpioCfg : buttonCfg.gpios)
+        {
+            if (gpioCfg.handle >= lines.size() ||
+                !lines[gpioCfg.handle].chip)
+            {
+                continue;
+            }
+            // A button that failed part way may have bound a copy of the
+            // gpio config, which is gone now
+            auto& line = lines[gpioCfg.handle];
+            if (line.gpio)
+            {
+                line.chip->boundLines--;
+                line.gpio = nullptr;
+            }
+            freeLine(gpioCfg.handle);
+        }
+    }
+
+    // The chips now request more lines than are bound, so a reload with
+    // nothing new requests them again with only the bound ones
+    std::vector<buttonConfig> noButtons;
+    reloadGpios(noButtons);
+}
+
+bool GpioRegistry::isAsserted(const gpioInfo& gpioConfig) const
+{
+    return (getValue(gpioConfig) == 0) ==
+           (gpioConfig.direction ==
+            gpiod::edge_event::event_type::FALLING_EDGE);
+}
+
+// Takes the current line state as the one the button has been told about,
+// which the software debouncer starts from
+void GpioRegistry::resetLineState(gpioInfo& gpioConfig) const
+{
+    if (!lines[gpioConfig.handle].chip->request)
+    {
+        return;
+    }
+
+    try
+    {
+        gpioConfig.reportedAsserted = isAsserted(gpioConfig);
+        gpioConfig.pendingAsserted = gpioConfig.reportedAsserted;
+    }
+    catch (const std::exception& e)
+    {
+        lg2::error("Failed to read {NAME}: {ERROR}", "NAME",
+                   gpioConfig.gpio_name, "ERROR", e);
+    }
+}
+
+// Catches the buttons up with lines that have been requested again. The
+// edges in between are lost, so a line that isn't in the state its button
+// was last told about gets one edge for the difference, stamped now. Each
+// button is then told its lines are back, once.
+void GpioRegistry::resyncLines(const std::vector<gpioInfo*>& gpios)
+{
+    auto now = std::chrono::steady_clock::now();
+    std::vector<gpioInfo*> resyncs;
+    for (auto* gpio : gpios)
+    {
+        // An edge held back by the debouncer is from the old request
+        if (gpio->debounceTimer)
+        {
+            gpio->debounceTimer->cancel();
+        }
+
+        bool asserted = false;
+        try
+        {
+            asserted = isAsserted(*gpio);
+        }
+        catch (const std::exception& e)
+        {
+            lg2::error("Failed to read {NAME}: {ERROR}", "NAME",
+                       gpio->gpio_name, "ERROR", e);
+            continue;
+        }
+        gpio->pendingAsserted = asserted;
+        if (!gpio->userdata || !gpio->handler)
+        {
+            continue;
+        }
+
+        if (asserted != gpio->reportedAsserted)
+        {
+            lg2::info("{NAME} changed while out of service", "NAME",
+                      gpio->gpio_name);
+            gpio->reportedAsserted = asserted;
+            gpio->handler(gpio->userdata,
+                          gpioEvent{gpio->index, asserted, now});
+        }
+        if (gpio->resyncHandler &&
+            std::none_of(resyncs.begin(), resyncs.end(),
+                         [gpio](const gpioInfo* other) {
+            return other->userdata == gpio->userdata;
+        }))
+        {
+            resyncs.push_back(gpio);
+        }
+    }
+
+    for (auto* gpio : resyncs)
+    {
+        gpio->resyncHandler(gpio->userdata);
+    }
+}
+
+int GpioRegistry::bind(gpioInfo& gpioConfig)
+{
+    if (gpioConfig.handle >= lines.size() ||
+        !lines[gpioConfig.handle].chip)
+    {
+        std::string errMsg = "Failed to find the " + gpioConfig.gpio_name +
+                             " line for " + gpioConfig.button_name;
+        lg2::error(errMsg.c_str());
+        return -1;
+    }
+
+    // Events are passed on relative to the current line state
+    resetLineState(gpioConfig);
+
+    // Deliver the line's events to this gpio config from now on. A line
+    // on a chip that is out of service gets them once it is back.
+    auto& line = lines[gpioConfig.handle];
+    if (!line.gpio)
+    {
+        line.chip->boundLines++;
+    }
+    line.gpio = &gpioConfig;
+
+    std::string msg = "Button GPIO configured: " + gpioConfig.button_name;
+    lg2::info(msg.c_str());
+    return 0;
+}
+
+void GpioRegistry::unbind(const gpioInfo& gpioConfig)
+{
+    if (gpioConfig.handle >= lines.size() ||
+        lines[gpioConfig.handle].gpio != &gpioConfig)
+    {
+        // Never bound, or released with its chip already
+        return;
+    }
+
+    auto& line = lines[gpioConfig.handle];
+    auto& chip = *line.chip;
+    line.gpio = nullptr;
+    chip.boundLines--;
+    lg2::info("Released the {NAME} line", "NAME", gpioConfig.button_name);
+
+    // Release the request once none of its lines are in use
+    if (chip.boundLines == 0)
+    {
+        releaseChip(chip);
+    }
+}
+
+int GpioRegistry::getValue(const gpioInfo& gpioConfig) const
+{
+    if (gpioConfig.handle >= lines.size() ||
+        !lines[gpioConfig.handle].chip ||
+        !lines[gpioConfig.handle].chip->request)
+    {
+        throw std::runtime_error("GPIO " + gpioConfig.gpio_name +
+                                 " is not requested");
+    }
+    const auto& line = lines[gpioConfig.handle];
+    return line.chip->request->getValue(line.offset);
+}
+
+std::vector<int>
+    GpioRegistry::getValues(const std::vector<gpioInfo>& gpios) const
+{
+    // Read all the lines on each chip with a single call, so they are
+    // sampled together
+    std::map<chipRequest*, std::vector<size_t>> indexesByChip;
+    for (size_t index = 0; index < gpios.size(); index++)
+    {
+        auto lineHandle = gpios[index].handle;
+        if (lineHandle >= lines.size() || !lines[lineHandle].chip ||
+            !lines[lineHandle].chip->request)
+        {
+            throw std::runtime_error("GPIO " + gpios[index].gpio_name +
+                                     " is not requested");
+        }
+        indexesByChip[lines[lineHandle].chip].push_back(index);
+    }
+
+    std::vector<int> result(gpios.size(), 0);
+    for (const auto& [chip, indexes] : indexesByChip)
+    {
+        std::vector<unsigned int> offsets;
+        for (auto index : indexes)
+        {
+            offsets.push_back(lines[gpios[index].handle].offset);
+        }
+        auto values = chip->request->getValues(offsets);
+        for (size_t line = 0; line < indexes.size(); line++)
+        {
+            result[indexes[line]] = values[line];
+        }
+    }
+    return result;
+}
+
+gpioInfo* GpioRegistry::find(handle lineHandle) const
+{
+    return lineHandle < lines.size() ? lines[lineHandle].gpio : nullptr;
+}
+
+gpioInfo* GpioRegistry::find(const std::string& chipPath,
+                             unsigned int offset) const
+{
+    auto chip = chips.find(chipPath);
+    if (chip == chips.end() || offset >= chip->second->handles.size())
+    {
+        return nullptr;
+    }
+    return find(chip->second->handles[offset]);
+}
+
+std::shared_ptr<sdbusplus::asio::dbus_interface>
+    GpioRegistry::addDebugInterface(sdbusplus::asio::object_server& server,
+                                    const std::string& path)
+{
+    auto iface = server.add_interface(path, gpioRegistryIface);
+
+    // True while any chip is out of service and waiting for a retry
+    iface->register_property("Degraded", degraded);
+
+    // Returns the handle, button, line name, chip, offset and fd of each
+    // requested line, and its event, overflow, dropped, debounced, fault
+    // and recovery counts. The fd is -1 while the chip is out of service.
+    iface->register_method("GetLines", [this]() {
+        std::vector<std::tuple<uint32_t, std::string, std::string,
+                               std::string, uint32_t, int32_t, uint64_t,
+                               uint64_t, uint64_t, uint64_t, uint64_t,
+                               uint64_t>>
+            result;
+        for (handle lineHandle = 0; lineHandle < lines.size(); lineHandle++)
+        {
+            const auto& line = lines[lineHandle];
+            if (!line.chip)
+            {
+                continue;
+            }
+            std::string buttonName;
+            std::string gpioName;
+            gpioEventStats stats;
+            if (line.gpio)
+            {
+                buttonName = line.gpio->button_name;
+                gpioName = line.gpio->gpio_name;
+                stats = line.gpio->stats;
+            }
+            result.emplace_back(
+                lineHandle, buttonName, gpioName, line.chip->path,
+                line.offset,
+                line.chip->request ? line.chip->request->fd() : -1,
+                stats.events, stats.overflows, stats.dropped, stats.debounced,
+                stats.faults, stats.recoveries);
+        }
+        return result;
+    });
+
+    // Returns the path, fd, line count, wakeups and largest event batch
+    // of each chip request, and how often it failed and came back
+    iface->register_method("GetChips", [this]() {
+        std::vector<std::tuple<std::string, int32_t, uint32_t, uint64_t,
+                               uint64_t, uint64_t, uint64_t>>
+            result;
+        for (const auto& [chipPath, chip] : chips)
+        {
+            result.emplace_back(
+                chipPath, chip->request ? chip->request->fd() : -1,
+                static_cast<uint32_t>(chip->handles.size() -
+                                      std::count(chip->handles.begin(),
+                                                 chip->handles.end(),
+                                                 noHandle)),
+                chip->wakeups,
+                static_cast<uint64_t>(chip->maxEventsPerWakeup),
+                chip->faults, chip->recoveries);
+        }
+        return result;
+    });
+
+    iface->initialize();
+    debugIface = iface;
+    return iface;
+}
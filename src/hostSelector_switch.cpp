@@ -1,24 +1,24 @@
-
 #include "hostSelector_switch.hpp"
 
 #include <error.h>
 
 #include <phosphor-logging/lg2.hpp>
 
+#include <algorithm>
+#include <charconv>
+
 // add the button iface class to registry
 static ButtonIFRegister<HostSelector> buttonRegister;
 
 size_t HostSelector::getMappedHSConfig(size_t hsPosition)
 {
     size_t adjustedPosition = INVALID_INDEX; // set bmc as default value
-    std::string hsPosStr;
-    hsPosStr = std::to_string(hsPosition);
 
-    if (hsPosMap.find(hsPosStr) != hsPosMap.end())
+    if (hsPosition < hsPosTable.size())
     {
-        adjustedPosition = hsPosMap[hsPosStr];
+        adjustedPosition = hsPosTable[hsPosition];
     }
-    else
+    if (adjustedPosition == INVALID_INDEX)
     {
         lg2::debug("getMappedHSConfig : {TYPE}: no valid value in map.", "TYPE",
                    getFormFactorType());
@@ -26,51 +26,167 @@ size_t HostSelector::getMappedHSConfig(size_t hsPosition)
     return adjustedPosition;
 }
 
-size_t HostSelector::getGpioIndex(std::string gpio_name)
+void HostSelector::parseConfig(const nlohmann::json& buttonJson,
+                               buttonConfig& buttonCfg)
 {
-    for (size_t index = 0; index < gpioLineCount; index++)
+    auto& settings = buttonCfg.extraInfo.emplace<hostSelectorConfig>();
+    settings.maxPosition = buttonJson.at("max_position");
+    settings.settleTime = std::chrono::milliseconds(
+        buttonJson.value("settle_ms", HOST_SELECTOR_SETTLE_MS));
+    settings.minPositionInterval = std::chrono::milliseconds(
+        buttonJson.value("min_position_interval_ms", 0U));
+
+    const auto hsPosMap = buttonJson.at("host_selector_map")
+                              .get<std::map<std::string, int>>();
+    for (const auto& [hsPosStr, host] : hsPosMap)
     {
-        if (config.gpios[index].gpio_name == gpio_name)
+        size_t hsPosition = 0;
+        auto [end, ec] = std::from_chars(
+            hsPosStr.data(), hsPosStr.data() + hsPosStr.size(), hsPosition);
+        if (ec != std::errc() || end != hsPosStr.data() + hsPosStr.size())
         {
-            return index;
+            lg2::error(
+                "HOST_SELECTOR: ignoring host selector map entry {VALUE}",
+                "VALUE", hsPosStr);
+            continue;
         }
+        settings.positions.emplace_back(hsPosition, host);
     }
-    return INVALID_INDEX;
 }
 
-void HostSelector::setInitialHostSelectorValue()
+void HostSelector::setPositionTable(
+    const std::vector<std::pair<size_t, size_t>>& positions)
 {
-    for (size_t index = 0; index < gpioLineCount; index++)
+    // The switch value has a bit for each of the first 8 gpios
+    hsPosTable.assign(size_t{1} << std::min<size_t>(gpioLineCount, 8),
+                      INVALID_INDEX);
+
+    for (const auto& [hsPosition, host] : positions)
     {
-        auto value = config.gpios[index].line.get_value();
-        GpioState gpioState = (value == 0) ? (GpioState::low)
-                                           : (GpioState::high);
-        setHostSelectorValue(config.gpios[index].gpio_name, gpioState);
-        size_t hsPosMapped = getMappedHSConfig(hostSelectorPosition);
-        if (hsPosMapped != INVALID_INDEX)
+        if (hsPosition >= hsPosTable.size())
         {
-            position(hsPosMapped, true);
+            // The switch can never read this value
+            lg2::error("{TYPE}: ignoring host selector map entry {VALUE}",
+                       "TYPE", getFormFactorType(), "VALUE", hsPosition);
+            continue;
         }
+        hsPosTable[hsPosition] = host;
     }
 }
 
-void HostSelector::setHostSelectorValue(std::string gpio_name, GpioState state)
+void HostSelector::readHostSelectorValue()
 {
-    size_t pos = getGpioIndex(gpio_name);
+    // Sample every line at once so the value is one the switch really had
+    auto values = getGpioValues(config.gpios);
+
+    // A low gpio sets its bit, for up to the first 8 gpios
+    hostSelectorPosition = 0;
+    for (size_t index = 0; index < std::min<size_t>(gpioLineCount, 8);
+         index++)
+    {
+        if (values[index] == 0)
+        {
+            hostSelectorPosition |= size_t{1} << index;
+        }
+    }
+}
+
+void HostSelector::setInitialHostSelectorValue()
+{
+    try
+    {
+        readHostSelectorValue();
+    }
+    catch (const std::exception& e)
+    {
+        // The gpios may be out of service, with the position read by
+        // resync() once they are back
+        lg2::error("{TYPE}: failed to read the gpios: {ERROR}", "TYPE",
+                   getFormFactorType(), "ERROR", e);
+        return;
+    }
+    size_t hsPosMapped = getMappedHSConfig(hostSelectorPosition);
+    if (hsPosMapped != INVALID_INDEX)
+    {
+        position(hsPosMapped, true);
+    }
+}
 
-    if (pos == INVALID_INDEX)
+void HostSelector::setSettledHostSelectorValue()
+{
+    try
+    {
+        readHostSelectorValue();
+    }
+    catch (const std::exception& e)
     {
+        lg2::error("{TYPE}: failed to read the gpios: {ERROR}", "TYPE",
+                   getFormFactorType(), "ERROR", e);
         return;
     }
-    auto set_bit = [](size_t& val, size_t n) { val |= 0xff & (1 << n); };
 
-    auto clr_bit = [](size_t& val, size_t n) { val &= ~(0xff & (1 << n)); };
+    lg2::debug(
+        "{TYPE}: settled at {VALUE}, {SUPPRESSED} intermediate values suppressed so far",
+        "TYPE", getFormFactorType(), "VALUE", hostSelectorPosition,
+        "SUPPRESSED", suppressedStates);
 
-    auto bit_op = (state == GpioState::low) ? set_bit : clr_bit;
+    size_t hsPosMapped = getMappedHSConfig(hostSelectorPosition);
 
-    bit_op(hostSelectorPosition, pos);
-    return;
+    if (hsPosMapped != INVALID_INDEX)
+    {
+        publishPosition(hsPosMapped);
+    }
 }
+
+void HostSelector::publishPosition(size_t hsPosMapped)
+{
+    // A newer position replaces one that is waiting to be sent
+    if (pendingPosition)
+    {
+        suppressedPositions++;
+        pendingPosition = hsPosMapped;
+        return;
+    }
+
+    // Different switch values can map to the same host
+    if (hsPosMapped == position())
+    {
+        suppressedPositions++;
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastPositionTime < minPositionInterval)
+    {
+        pendingPosition = hsPosMapped;
+        positionTimer.expires_at(lastPositionTime + minPositionInterval);
+        positionTimer.async_wait([this](const boost::system::error_code ec) {
+            if (ec)
+            {
+                return;
+            }
+            emitPendingPosition();
+        });
+        return;
+    }
+
+    lastPositionTime = now;
+    emittedPositions++;
+    position(hsPosMapped);
+    lg2::debug(
+        "{TYPE}: position {POSITION}, {EMITTED} sent and {SUPPRESSED} suppressed so far",
+        "TYPE", getFormFactorType(), "POSITION", hsPosMapped, "EMITTED",
+        emittedPositions, "SUPPRESSED", suppressedPositions);
+}
+
+void HostSelector::emitPendingPosition()
+{
+    auto hsPosMapped = *pendingPosition;
+    pendingPosition.reset();
+    // The switch may have gone back to the position that was last sent
+    publishPosition(hsPosMapped);
+}
+
 /**
  * @brief This method is called from sd-event provided callback function
  * callbackHandler if platform specific event handling is needed then a
@@ -78,17 +194,24 @@ void HostSelector::setHostSelectorValue(std::string gpio_name, GpioState state)
  * init() function can be created to override the default event handling
  */
 
-void HostSelector::handleEvent(bool asserted, std::string gpio_name)
+void HostSelector::handleEvent(const gpioEvent& /* event */)
 {
-    // read the gpio state for the io event received
-    GpioState gpioState = (asserted) ? (GpioState::low) : (GpioState::high);
-
-    setHostSelectorValue(gpio_name, gpioState);
-
-    size_t hsPosMapped = getMappedHSConfig(hostSelectorPosition);
+    // Wait for the switch to stop moving, then read all of its gpios.
+    // Restarting the wait drops the value the last edge would have given.
+    suppressedStates += settleTimer.expires_after(settleTime);
+    settleTimer.async_wait([this](const boost::system::error_code ec) {
+        if (ec)
+        {
+            return;
+        }
+        setSettledHostSelectorValue();
+    });
+}
 
-    if (hsPosMapped != INVALID_INDEX)
-    {
-        position(hsPosMapped);
-    }
+void HostSelector::resync()
+{
+    // The gpios are back in service and all read at once now, so there is
+    // nothing left to wait for
+    settleTimer.cancel();
+    setSettledHostSelectorValue();
 }
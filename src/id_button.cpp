@@ -16,6 +16,10 @@
 
 #include "id_button.hpp"
 
+#include "latency.hpp"
+
+#include <phosphor-logging/lg2.hpp>
+
 // add the button iface class to registry
 static ButtonIFRegister<IDButton> buttonRegister;
 
@@ -24,20 +28,27 @@ void IDButton::simPress()
     pressed();
 }
 
-void IDButton::handleEvent(bool asserted, std::string /* gpio_name */)
+void IDButton::handleEvent(const gpioEvent& event)
 {
-    if (asserted)
+    auto dispatched = std::chrono::steady_clock::now();
+
+    if (event.asserted)
     {
-        phosphor::logging::log<phosphor::logging::level::DEBUG>(
-            (getFormFactorType() + " : pressed").c_str());
+        lg2::debug("ID_BUTTON: pressed");
         // emit pressed signal
         pressed();
     }
     else
     {
-        phosphor::logging::log<phosphor::logging::level::DEBUG>(
-            (getFormFactorType() + " : released").c_str());
+        lg2::debug("ID_BUTTON: released");
         // released
         released();
+#ifdef FUSED_HANDLER
+        phosphor::button::notifyInProcessHandler(
+            &phosphor::button::Handler::idReleased);
+#endif
     }
+
+    phosphor::button::latency::record(
+        phosphor::button::latency::Stage::dispatchToSignal, dispatched);
 }
@@ -0,0 +1,160 @@
+#include "latency.hpp"
+
+#include <boost/asio/signal_set.hpp>
+#include <phosphor-logging/lg2.hpp>
+#include <xyz/openbmc_project/Common/error.hpp>
+
+#include <bit>
+#include <tuple>
+#include <vector>
+
+namespace phosphor
+{
+namespace button
+{
+namespace latency
+{
+
+constexpr auto latencyIface =
+    "xyz.openbmc_project.Chassis.Buttons.Debug.Latency";
+
+static constexpr std::array<std::string_view,
+                            static_cast<size_t>(Stage::count)>
+    stageNames = {"EdgeToDispatch", "DispatchToSignal", "SignalToTransition",
+                  "SignalToLed"};
+
+static std::array<Histogram, static_cast<size_t>(Stage::count)> histograms;
+
+std::string_view getStageName(Stage stage)
+{
+    return stageNames[static_cast<size_t>(stage)];
+}
+
+void Histogram::record(std::chrono::steady_clock::duration duration)
+{
+    auto us = static_cast<uint64_t>(std::max<int64_t>(
+        0, std::chrono::duration_cast<std::chrono::microseconds>(duration)
+               .count()));
+
+    // std::bit_width(us) is 0 for 0 us and N for 2^(N-1) to 2^N - 1 us
+    buckets[std::min<size_t>(std::bit_width(us), bucketCount - 1)]++;
+    count++;
+    sumUs += us;
+    maxUs = std::max(maxUs, us);
+}
+
+void Histogram::reset()
+{
+    *this = Histogram{};
+}
+
+void record(Stage stage, std::chrono::steady_clock::duration duration)
+{
+    histograms[static_cast<size_t>(stage)].record(duration);
+}
+
+void record(Stage stage, std::chrono::steady_clock::time_point start)
+{
+    record(stage, std::chrono::steady_clock::now() - start);
+}
+
+const Histogram& getHistogram(Stage stage)
+{
+    return histograms[static_cast<size_t>(stage)];
+}
+
+void dumpToJournal()
+{
+    for (size_t stage = 0; stage < histograms.size(); stage++)
+    {
+        const auto& histogram = histograms[stage];
+        if (histogram.getCount() == 0)
+        {
+            continue;
+        }
+
+        // Only list the buckets in use, as "<upper bound us>:<count>"
+        std::string buckets;
+        for (size_t bucket = 0; bucket < Histogram::bucketCount; bucket++)
+        {
+            if (histogram.getBuckets()[bucket] == 0)
+            {
+                continue;
+            }
+            buckets += (buckets.empty() ? "" : " ") +
+                       std::to_string(uint64_t{1} << bucket) + ":" +
+                       std::to_string(histogram.getBuckets()[bucket]);
+        }
+
+        lg2::info(
+            "Latency {STAGE}: {COUNT} samples, mean {MEAN} us, max {MAX} us, buckets {BUCKETS}",
+            "STAGE", std::string(stageNames[stage]), "COUNT",
+            histogram.getCount(), "MEAN", histogram.getMeanUs(), "MAX",
+            histogram.getMaxUs(), "BUCKETS", buckets);
+    }
+}
+
+void reset()
+{
+    for (auto& histogram : histograms)
+    {
+        histogram.reset();
+    }
+}
+
+static void waitForSignal(std::shared_ptr<boost::asio::signal_set> signals)
+{
+    signals->async_wait(
+        [signals](const boost::system::error_code ec, int /* signal */) {
+        if (ec)
+        {
+            return;
+        }
+        dumpToJournal();
+        waitForSignal(signals);
+    });
+}
+
+void dumpOnSignal(boost::asio::io_context& io, int signalNumber)
+{
+    waitForSignal(std::make_shared<boost::asio::signal_set>(io, signalNumber));
+}
+
+std::shared_ptr<sdbusplus::asio::dbus_interface>
+    addDebugInterface(sdbusplus::asio::object_server& server,
+                      const std::string& path)
+{
+    auto iface = server.add_interface(path, latencyIface);
+
+    std::vector<std::string> names(stageNames.begin(), stageNames.end());
+    iface->register_property("Stages", names);
+
+    // Returns the sample count, mean and max in us, and the bucket counts
+    iface->register_method("GetStage", [](const std::string& name) {
+        for (size_t stage = 0; stage < stageNames.size(); stage++)
+        {
+            if (stageNames[stage] != name)
+            {
+                continue;
+            }
+            const auto& histogram = histograms[stage];
+            return std::make_tuple(
+                histogram.getCount(), histogram.getMeanUs(),
+                histogram.getMaxUs(),
+                std::vector<uint64_t>(histogram.getBuckets().begin(),
+                                      histogram.getBuckets().end()));
+        }
+        throw sdbusplus::xyz::openbmc_project::Common::Error::
+            InvalidArgument();
+    });
+
+    iface->register_method("Dump", []() { dumpToJournal(); });
+    iface->register_method("Reset", []() { reset(); });
+
+    iface->initialize();
+    return iface;
+}
+
+} // namespace latency
+} // namespace button
+} // namespace phosphor
@@ -15,92 +15,215 @@
 */
 
 #include "button_factory.hpp"
+#include "button_handler.hpp"
 #include "gpio.hpp"
+#include "gpio_cache.hpp"
+#include "gpio_defs.hpp"
+#include "gpio_registry.hpp"
+#include "latency.hpp"
 #include "xyz/openbmc_project/Chassis/Buttons/Reset/server.hpp"
 
+#include <malloc.h>
+
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/signal_set.hpp>
 #include <gpiod.hpp>
-#include <nlohmann/json.hpp>
 #include <phosphor-logging/elog-errors.hpp>
+#include <phosphor-logging/lg2.hpp>
 #include <sdbusplus/asio/object_server.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <functional>
+
 static constexpr auto gpioDefFile = "/etc/default/obmc/gpio/gpio_defs.json";
+static constexpr auto gpioDefsCacheFile =
+    "/var/lib/phosphor-buttons/gpio_defs.cache";
 
-nlohmann::json gpioDefs;
 boost::asio::io_service io;
 
-int main(void)
+// Applies an edited gpio defs file to the running buttons. The buttons
+// whose entry is unchanged keep their D-Bus objects and gpio lines, and
+// only the gpiochips with lines being added or removed are requested again.
+static void
+    reloadButtons(const std::string& gpioDefPath,
+                  sdbusplus::asio::connection& conn, GpioRegistry& gpios,
+                  std::vector<std::unique_ptr<ButtonIface>>& buttonInterfaces)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<buttonConfig> newBtnCfgs;
+    if (loadGpioDefs(gpioDefPath, newBtnCfgs) != 0)
+    {
+        lg2::error("Not reloading {FILE} while it has errors", "FILE",
+                   gpioDefPath);
+        return;
+    }
+
+    // Keep the buttons that are still configured the same, leaving only
+    // the configs of new buttons
+    std::vector<std::unique_ptr<ButtonIface>> keptButtons;
+    for (auto& button : buttonInterfaces)
+    {
+        auto newCfg = std::find_if(newBtnCfgs.begin(), newBtnCfgs.end(),
+                                   [&button](const auto& buttonCfg) {
+            return isSameButtonConfig(buttonCfg, button->getConfig());
+        });
+        if (newCfg != newBtnCfgs.end())
+        {
+            newBtnCfgs.erase(newCfg);
+            keptButtons.push_back(std::move(button));
+        }
+    }
+    size_t removed = buttonInterfaces.size() - keptButtons.size();
+
+    // Removing the other buttons releases their objects and lines first, so
+    // their replacements can take them
+    buttonInterfaces = std::move(keptButtons);
+    if (gpios.reloadGpios(newBtnCfgs) < 0)
+    {
+        lg2::error("Failed to request some button gpios");
+    }
+
+    size_t added = 0;
+    std::vector<buttonConfig> failedBtnCfgs;
+    for (auto& buttonCfg : newBtnCfgs)
+    {
+        try
+        {
+            auto tempButtonIf = ButtonFactory::instance().createInstance(
+                buttonCfg.formFactorName, conn, buttonCfg, io);
+            if (tempButtonIf)
+            {
+                buttonInterfaces.emplace_back(std::move(tempButtonIf));
+                added++;
+                continue;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            lg2::error("Failed to create {BUTTON}: {ERROR}", "BUTTON",
+                       buttonCfg.formFactorName, "ERROR", e);
+        }
+        failedBtnCfgs.push_back(std::move(buttonCfg));
+    }
+
+    // Don't keep lines from other consumers for buttons that aren't there
+    if (!failedBtnCfgs.empty())
+    {
+        gpios.releaseGpios(failedBtnCfgs);
+    }
+
+    auto took = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    lg2::info("Reloaded {FILE} in {TIME} us: {KEPT} buttons kept, {REMOVED} "
+              "removed, {ADDED} added",
+              "FILE", gpioDefPath, "TIME", took.count(), "KEPT",
+              buttonInterfaces.size() - added, "REMOVED", removed, "ADDED",
+              added);
+}
+
+int main(int argc, char* argv[])
 {
     int ret = 0;
 
     phosphor::logging::log<phosphor::logging::level::INFO>(
         "Start Phosphor buttons service...");
 
+    // The bus and the gpio lines are all serviced by the one io loop
     std::shared_ptr<sdbusplus::asio::connection> conn =
         std::make_shared<sdbusplus::asio::connection>(io);
-
-    sdbusplus::bus::bus bus = sdbusplus::bus::new_default();
     sdbusplus::server::manager::manager objManager{
-        bus, "/xyz/openbmc_project/Chassis/Buttons"};
+        *conn, "/xyz/openbmc_project/Chassis/Buttons"};
 
-    bus.request_name("xyz.openbmc_project.Chassis.Buttons");
+    conn->request_name("xyz.openbmc_project.Chassis.Buttons");
+    sdbusplus::asio::object_server server{conn, true};
+    // Declared first, so the buttons using its lines go before it does
+    GpioRegistry gpios{io};
     std::vector<std::unique_ptr<ButtonIface>> buttonInterfaces;
     std::vector<buttonConfig> allBtnCfgs;
 
-    std::ifstream gpios{gpioDefFile};
-    auto gpioDefJson = nlohmann::json::parse(gpios, nullptr, true);
-    gpioDefs = gpioDefJson["gpio_definitions"];
-
-    // load gpio config from gpio defs json file and create button interface
-    // objects based on the button form factor type
-    for (const auto& gpioConfig : gpioDefs)
+    // The gpio defs file can be given on the command line, e.g. to run
+    // against lines from the gpio-sim kernel module
+    std::string gpioDefPath = (argc > 1) ? argv[1] : gpioDefFile;
+    bool fromCache = loadGpioDefsCache(gpioDefsCacheFile, gpioDefPath,
+                                       allBtnCfgs);
+    int defsErrors = 0;
+    if (!fromCache)
     {
-        std::string formFactorName = gpioConfig["name"];
-        buttonConfig buttonCfg;
-        buttonCfg.formFactorName = formFactorName;
-        buttonCfg.extraJsonInfo = gpioConfig;
-
-        /* The folloing code checks if the gpio config read
-        from json file is single gpio config or group gpio config,
-        based on that further data is processed. */
-        if (gpioConfig.contains("group_gpio_config"))
+        defsErrors = loadGpioDefs(gpioDefPath, allBtnCfgs);
+        if (defsErrors != 0)
         {
-            const auto& groupGpio = gpioConfig["group_gpio_config"];
-
-            for (const auto& config : groupGpio)
-            {
-                gpioInfo gpioCfg = gpioInfo{config["name"], config["gpio_name"],
-                                            config["direction"]};
-                buttonCfg.gpios.push_back(gpioCfg);
-            }
-        }
-        else
-        {
-            gpioInfo gpioCfg = gpioInfo{gpioConfig["name"],
-                                        gpioConfig["gpio_name"],
-                                        gpioConfig["direction"]};
-            buttonCfg.gpios.push_back(gpioCfg);
+            lg2::error("Errors in {FILE}, some buttons were left out", "FILE",
+                       gpioDefPath);
         }
+    }
 
+    // Request all the lines up front so each gpiochip needs one request
+    if (gpios.requestGpios(allBtnCfgs) < 0)
+    {
+        phosphor::logging::log<phosphor::logging::level::ERR>(
+            "Failed to request some button gpios");
+    }
+    else if (!fromCache && defsErrors == 0)
+    {
+        // Every line was found, so the next start can skip the lookups
+        saveGpioDefsCache(gpioDefsCacheFile, gpioDefPath, allBtnCfgs);
+    }
+
+    for (auto& buttonCfg : allBtnCfgs)
+    {
         // Call button factory to create instances of this button
         auto tempButtonIf = ButtonFactory::instance().createInstance(
-            formFactorName, bus, buttonCfg, io);
+            buttonCfg.formFactorName, *conn, buttonCfg, io);
 
-        /* There are additional gpio configs present in some platforms
-         that are not supported in phosphor-buttons.
-        But they may be used by other applications. so skipping such configs
-        if present in gpio_defs.json file*/
         if (tempButtonIf)
         {
             buttonInterfaces.emplace_back(std::move(tempButtonIf));
         }
-        allBtnCfgs.push_back(std::move(buttonCfg));
     }
     phosphor::logging::log<phosphor::logging::level::INFO>(
         "Finished configuring buttons.");
 
+    // Each button keeps its own copy of its config
+    allBtnCfgs.clear();
+    allBtnCfgs.shrink_to_fit();
+    lg2::info("Heap in use after startup: {BYTES} bytes", "BYTES",
+              mallinfo2().uordblks);
+
+#ifdef FUSED_HANDLER
+    // Act on the presses here rather than in a separate button-handler.
+    // The buttons call it directly and still send their signals for
+    // anyone else listening.
+    phosphor::button::Handler handler{*conn, false};
+    phosphor::button::inProcessHandler = &handler;
+#endif
+
+    // Expose the press handling latencies for debugging
+    auto latencyIface = phosphor::button::latency::addDebugInterface(
+        server, phosphor::button::latency::latencyObjectPath);
+    phosphor::button::latency::dumpOnSignal(io, SIGUSR1);
+
+    // and the requested gpio lines
+    auto gpiosIface = gpios.addDebugInterface(server, gpioRegistryObjectPath);
+
+    // Apply changes to the gpio defs on SIGHUP, without a restart
+    boost::asio::signal_set reloadSignal{io, SIGHUP};
+    std::function<void()> waitForReload = [&]() {
+        reloadSignal.async_wait(
+            [&](const boost::system::error_code ec, int /* signal */) {
+            if (ec)
+            {
+                return;
+            }
+            reloadButtons(gpioDefPath, *conn, gpios, buttonInterfaces);
+            waitForReload();
+        });
+    };
+    waitForReload();
+
     try
     {
         // Start asynchronous processes (blocking function)
@@ -111,8 +234,11 @@ int main(void)
         phosphor::logging::log<phosphor::logging::level::ERR>(e.what());
         ret = -1;
     }
+#ifdef FUSED_HANDLER
+    phosphor::button::inProcessHandler = nullptr;
+#endif
     // Close all potential gpio lines
-    std::for_each(allBtnCfgs.begin(), allBtnCfgs.end(),
-                  [](auto& cfg) { cfg.gpios.clear(); });
+    buttonInterfaces.clear();
+    gpios.releaseAll();
     return ret;
 }
@@ -16,6 +16,12 @@
 
 #include "power_button.hpp"
 
+#include "latency.hpp"
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+
 // add the button iface class to registry
 static ButtonIFRegister<PowerButton> buttonRegister;
 
@@ -27,11 +33,15 @@ void PowerButton::simPress()
 void PowerButton::simLongPress()
 {
     pressedLong();
+#ifdef FUSED_HANDLER
+    phosphor::button::notifyInProcessHandler(
+        &phosphor::button::Handler::longPowerPressed);
+#endif
 }
 
-void PowerButton::updatePressedTime()
+void PowerButton::updatePressedTime(gpioEventTime timestamp)
 {
-    pressedTime = std::chrono::steady_clock::now();
+    pressedTime = timestamp;
 }
 
 auto PowerButton::getPressTime() const
@@ -39,35 +49,135 @@ auto PowerButton::getPressTime() const
     return pressedTime;
 }
 
-void PowerButton::handleEvent(bool asserted, std::string /* gpio_name */)
+void PowerButton::parseConfig(const nlohmann::json& buttonJson,
+                              buttonConfig& buttonCfg)
 {
-    if (asserted)
+    auto& holdThresholds =
+        buttonCfg.extraInfo.emplace<powerButtonConfig>().holdThresholds;
+
+    if (!buttonJson.contains("hold_thresholds"))
+    {
+        holdThresholds.push_back(
+            {std::chrono::milliseconds(LONG_PRESS_TIME_MS), true});
+        return;
+    }
+
+    for (const auto& threshold : buttonJson["hold_thresholds"])
     {
-        phosphor::logging::log<phosphor::logging::level::DEBUG>(
-            "POWER_BUTTON: pressed");
+        std::string signal = threshold.at("signal");
+        if (signal != "PressedLong" && signal != "Released")
+        {
+            lg2::error("POWER_BUTTON: unknown hold signal {SIGNAL}", "SIGNAL",
+                       signal);
+            continue;
+        }
+        holdThresholds.push_back(
+            {std::chrono::milliseconds(threshold.at("time_ms").get<int>()),
+             signal == "PressedLong"});
+    }
+    std::sort(holdThresholds.begin(), holdThresholds.end(),
+              [](const auto& a, const auto& b) { return a.time < b.time; });
+}
+
+void PowerButton::startHoldTimer()
+{
+    if (holdLevel >= holdThresholds.size())
+    {
+        return;
+    }
+
+    // Time the hold from the press edge, not from when it was handled
+    holdTimer.expires_at(getPressTime() + holdThresholds[holdLevel].time);
+    holdTimer.async_wait([this](const boost::system::error_code ec) {
+        if (ec)
+        {
+            // Released before the threshold
+            return;
+        }
+        emitHoldSignal(holdLevel, holdThresholds[holdLevel].time);
+        holdLevel++;
+        startHoldTimer();
+    });
+}
 
-        updatePressedTime();
+void PowerButton::emitHoldSignal(size_t level,
+                                 std::chrono::milliseconds heldTime)
+{
+    lg2::info("POWER_BUTTON: held for {TIME} ms", "TIME", heldTime.count());
+
+    if (holdThresholds[level].pressedLong)
+    {
+        pressedLong();
+#ifdef FUSED_HANDLER
+        phosphor::button::notifyInProcessHandler(
+            &phosphor::button::Handler::longPowerPressed);
+#endif
+    }
+    else
+    {
+        released(
+            std::chrono::duration_cast<std::chrono::microseconds>(heldTime)
+                .count());
+#ifdef FUSED_HANDLER
+        phosphor::button::notifyInProcessHandler(
+            &phosphor::button::Handler::powerReleased);
+#endif
+    }
+}
+
+void PowerButton::handleEvent(const gpioEvent& event)
+{
+    // Time from the kernel seeing the edge to it being handled here
+    auto dispatched = std::chrono::steady_clock::now();
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+        dispatched - event.timestamp);
+
+    if (event.asserted)
+    {
+        lg2::debug("POWER_BUTTON: pressed, dispatched after {LATENCY} us",
+                   "LATENCY", latency.count());
+
+        updatePressedTime(event.timestamp);
         // emit pressed signal
         pressed();
+
+        holdLevel = 0;
+        startHoldTimer();
     }
     else
     {
-        phosphor::logging::log<phosphor::logging::level::DEBUG>(
-            "POWER_BUTTON: released");
-
-        auto now = std::chrono::steady_clock::now();
+        // Measure the press between the two edges so that scheduling
+        // delays don't skew the short vs long press decision
         auto d = std::chrono::duration_cast<std::chrono::milliseconds>(
-            now - getPressTime());
+            event.timestamp - getPressTime());
+
+        lg2::debug(
+            "POWER_BUTTON: released after {DURATION} ms, dispatched after {LATENCY} us",
+            "DURATION", d.count(), "LATENCY", latency.count());
 
-        if (d > std::chrono::milliseconds(LONG_PRESS_TIME_MS))
+        holdTimer.cancel();
+
+        // The press may have passed a threshold the timer didn't get to
+        auto reached = std::count_if(
+            holdThresholds.begin(), holdThresholds.end(),
+            [&d](const auto& threshold) { return d >= threshold.time; });
+        if (static_cast<size_t>(reached) > holdLevel)
         {
-            pressedLong();
+            emitHoldSignal(reached - 1, d);
         }
-        else
+        else if (holdLevel == 0)
         {
             // released
             released(std::chrono::duration_cast<std::chrono::microseconds>(d)
                          .count());
+#ifdef FUSED_HANDLER
+            phosphor::button::notifyInProcessHandler(
+                &phosphor::button::Handler::powerReleased);
+#endif
         }
+        holdLevel = 0;
     }
+
+    phosphor::button::latency::record(
+        phosphor::button::latency::Stage::dispatchToSignal, dispatched);
 }
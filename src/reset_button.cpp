@@ -16,8 +16,11 @@
 
 #include "reset_button.hpp"
 
+#include "latency.hpp"
 #include "xyz/openbmc_project/Chassis/Buttons/Reset/server.hpp"
 
+#include <phosphor-logging/lg2.hpp>
+
 // add the button iface class to registry
 static ButtonIFRegister<ResetButton> buttonRegister;
 
@@ -26,20 +29,27 @@ void ResetButton::simPress()
     pressed();
 }
 
-void ResetButton::handleEvent(bool asserted, std::string /* gpio_name */)
+void ResetButton::handleEvent(const gpioEvent& event)
 {
-    if (asserted)
+    auto dispatched = std::chrono::steady_clock::now();
+
+    if (event.asserted)
     {
-        phosphor::logging::log<phosphor::logging::level::DEBUG>(
-            (getFormFactorType() + " : pressed").c_str());
+        lg2::debug("RESET_BUTTON: pressed");
         // emit pressed signal
         pressed();
     }
     else
     {
-        phosphor::logging::log<phosphor::logging::level::DEBUG>(
-            (getFormFactorType() + " : released").c_str());
+        lg2::debug("RESET_BUTTON: released");
         // released
         released();
+#ifdef FUSED_HANDLER
+        phosphor::button::notifyInProcessHandler(
+            &phosphor::button::Handler::resetReleased);
+#endif
     }
+
+    phosphor::button::latency::record(
+        phosphor::button::latency::Stage::dispatchToSignal, dispatched);
 }
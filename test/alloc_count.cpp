@@ -0,0 +1,64 @@
+#include "alloc_count.hpp"
+
+#include <malloc.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Per thread, so a thread making edges doesn't count against the one
+// dispatching them
+static thread_local size_t allocations = 0;
+
+// The heap is shared, so its bytes are counted for all the threads. The
+// usable size is counted, as that is what a sized delete may not match.
+static std::atomic<size_t> heapInUse = 0;
+static std::atomic<size_t> heapPeak = 0;
+
+size_t getAllocationCount()
+{
+    return allocations;
+}
+
+size_t getHeapInUse()
+{
+    return heapInUse;
+}
+
+size_t getHeapPeak()
+{
+    return heapPeak;
+}
+
+void resetHeapPeak()
+{
+    heapPeak = heapInUse.load();
+}
+
+void* operator new(size_t size)
+{
+    allocations++;
+    if (void* ptr = std::malloc(size ? size : 1))
+    {
+        auto inUse = heapInUse += malloc_usable_size(ptr);
+        auto peak = heapPeak.load();
+        while (inUse > peak && !heapPeak.compare_exchange_weak(peak, inUse))
+        {}
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    if (ptr)
+    {
+        heapInUse -= malloc_usable_size(ptr);
+    }
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
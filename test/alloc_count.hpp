@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * @brief the number of times the calling thread has called operator new.
+ * Linking alloc_count.cpp into a test replaces the global operator new to
+ * count them.
+ */
+size_t getAllocationCount();
+
+/**
+ * @brief the bytes allocated with operator new, by any thread, and not
+ * freed yet
+ */
+size_t getHeapInUse();
+
+/**
+ * @brief the most getHeapInUse() has been since the last
+ * resetHeapPeak()
+ */
+size_t getHeapPeak();
+
+/**
+ * @brief starts measuring the peak again from the heap in use now
+ */
+void resetHeapPeak();
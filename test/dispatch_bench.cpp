@@ -0,0 +1,190 @@
+#include "alloc_count.hpp"
+#include "button_factory.hpp"
+#include "button_interface.hpp"
+#include "fake_gpio_backend.hpp"
+#include "gpio.hpp"
+#include "gpio_defs.hpp"
+#include "gpio_registry.hpp"
+#include "latency.hpp"
+
+#include <unistd.h>
+
+#include <boost/asio/io_context.hpp>
+#include <sdbusplus/asio/connection.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Replays a trace of presses on fake gpio lines through the registry to
+// the power, reset and ID buttons, as the buttons daemon gets them, and
+// reports the events per second, the edge to dispatch and dispatch to
+// signal latencies and the allocations per event. The buttons send their
+// signals on the session bus, so it is run under dbus-run-session, and is
+// skipped without a session bus.
+//
+// usage: dispatch_bench [presses]
+
+using namespace std::chrono_literals;
+namespace latency = phosphor::button::latency;
+
+namespace
+{
+
+constexpr auto chipPath = "/dev/gpiochip-bench";
+const std::vector<std::string> lineNames = {"BENCH_POWER_BTN_L",
+                                            "BENCH_RESET_BTN_L",
+                                            "BENCH_ID_BTN_N"};
+
+constexpr auto gpioDefs = R"({
+    "gpio_definitions": [
+        {
+            "name": "POWER_BUTTON",
+            "gpio_name": "BENCH_POWER_BTN_L",
+            "direction": "falling"
+        },
+        {
+            "name": "RESET_BUTTON",
+            "gpio_name": "BENCH_RESET_BTN_L",
+            "direction": "falling"
+        },
+        {
+            "name": "ID_BTN",
+            "gpio_name": "BENCH_ID_BTN_N",
+            "direction": "falling"
+        }
+    ]
+})";
+
+// one press in the trace: the line, how long it is held and the time
+// until the next press
+struct tracePress
+{
+    unsigned int offset;
+    std::chrono::microseconds held;
+    std::chrono::microseconds gap;
+};
+
+// Presses spread over the lines, with the hold and gap times varied the
+// way a person's would be
+std::vector<tracePress> makeTrace(size_t presses)
+{
+    std::vector<tracePress> trace;
+    trace.reserve(presses);
+    for (size_t press = 0; press < presses; press++)
+    {
+        trace.push_back(
+            {static_cast<unsigned int>(press % lineNames.size()),
+             std::chrono::microseconds(100 + (press * 37) % 400),
+             std::chrono::microseconds(50 + (press * 53) % 200)});
+    }
+    return trace;
+}
+
+void printLatency(const char* name, latency::Stage stage)
+{
+    const auto& histogram = latency::getHistogram(stage);
+    std::printf("%-22s  mean %llu us, max %llu us\n", name,
+                static_cast<unsigned long long>(histogram.getMeanUs()),
+                static_cast<unsigned long long>(histogram.getMaxUs()));
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t presses = argc > 1 ? std::stoul(argv[1]) : 2000;
+
+    boost::asio::io_context io;
+    std::shared_ptr<sdbusplus::asio::connection> conn;
+    try
+    {
+        conn = std::make_shared<sdbusplus::asio::connection>(
+            io, sdbusplus::bus::new_user());
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "No session bus, skipping: %s\n", e.what());
+        // The exit code meson takes as a skip
+        return 77;
+    }
+
+    FakeGpioBackend gpios;
+    gpios.addChip(chipPath, "bench-gpio", lineNames);
+
+    // The buttons are configured as the daemon configures them
+    auto defsPath = std::filesystem::temp_directory_path() /
+                    ("dispatch_bench_" + std::to_string(getpid()) + ".json");
+    {
+        std::ofstream file(defsPath);
+        file << gpioDefs;
+    }
+    std::vector<buttonConfig> configs;
+    int defsErrors = loadGpioDefs(defsPath, configs);
+    std::filesystem::remove(defsPath);
+
+    // Declared before the buttons, which unbind their lines when they go
+    GpioRegistry registry(io);
+    std::vector<std::unique_ptr<ButtonIface>> buttons;
+    if (defsErrors != 0 || registry.requestGpios(configs) != 0)
+    {
+        std::fprintf(stderr, "Failed to set up the bench gpios\n");
+        return 1;
+    }
+    for (auto& config : configs)
+    {
+        auto button = ButtonFactory::instance().createInstance(
+            config.formFactorName, *conn, config, io);
+        if (!button)
+        {
+            std::fprintf(stderr, "Failed to create %s\n",
+                         config.formFactorName.c_str());
+            return 1;
+        }
+        buttons.push_back(std::move(button));
+    }
+
+    auto trace = makeTrace(presses);
+    size_t expected = trace.size() * 2;
+    latency::reset();
+    const auto& dispatch = latency::getHistogram(
+        latency::Stage::edgeToDispatch);
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread player([&gpios, &trace]() {
+        for (const auto& press : trace)
+        {
+            gpios.press(chipPath, press.offset, press.held);
+            std::this_thread::sleep_for(press.gap);
+        }
+    });
+
+    auto allocations = getAllocationCount();
+    auto deadline = start + 60s;
+    while (dispatch.getCount() < expected &&
+           std::chrono::steady_clock::now() < deadline)
+    {
+        io.restart();
+        io.run_one_for(100ms);
+    }
+    allocations = getAllocationCount() - allocations;
+    auto elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start);
+    player.join();
+
+    size_t events = dispatch.getCount();
+    std::printf("buttons:                 %zu\n", buttons.size());
+    std::printf("events:                  %zu of %zu\n", events, expected);
+    std::printf("events/s:                %.0f\n", events / elapsed.count());
+    printLatency("edge to dispatch:", latency::Stage::edgeToDispatch);
+    printLatency("dispatch to signal:", latency::Stage::dispatchToSignal);
+    std::printf("allocations per event:   %.3f\n",
+                events ? static_cast<double>(allocations) / events : 0.0);
+
+    return events == expected ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+#include "alloc_count.hpp"
+#include "button_interface.hpp"
+#include "gpio.hpp"
+#include "latency.hpp"
+
+#include <systemd/sd-bus.h>
+
+#include <boost/asio/io_context.hpp>
+#include <sdbusplus/bus.hpp>
+
+#include <chrono>
+#include <type_traits>
+
+#include <gtest/gtest.h>
+
+namespace latency = phosphor::button::latency;
+
+namespace
+{
+
+// Counts the events, doing no more per event than a button has to
+class CountingButton : public ButtonIface
+{
+  public:
+    CountingButton(sdbusplus::bus::bus& bus, buttonConfig& buttonCfg,
+                   boost::asio::io_context& io) :
+        ButtonIface(bus, buttonCfg, io)
+    {}
+
+    void handleEvent(const gpioEvent& event) override
+    {
+        events++;
+        lastEvent = event;
+    }
+
+    size_t events = 0;
+    gpioEvent lastEvent{};
+};
+
+class EventDispatchTest : public ::testing::Test
+{
+  protected:
+    EventDispatchTest() : bus(newBus(), std::false_type())
+    {
+        // The gpio is set up as the ButtonIface constructor does it, which
+        // can't request one without hardware
+        gpio.index = 2;
+        gpio.handler = ButtonIface::EventHandler;
+        gpio.userdata = &button;
+    }
+
+    // The buttons never use the bus while dispatching, so it isn't
+    // connected
+    static sd_bus* newBus()
+    {
+        sd_bus* newBus = nullptr;
+        sd_bus_new(&newBus);
+        return newBus;
+    }
+
+    // Passes an edge on as the registry does
+    void dispatch(bool asserted)
+    {
+        auto timestamp = std::chrono::steady_clock::now();
+        latency::record(latency::Stage::edgeToDispatch, timestamp);
+        gpio.handler(gpio.userdata,
+                     gpioEvent{gpio.index, asserted, timestamp});
+    }
+
+    boost::asio::io_context io;
+    sdbusplus::bus::bus bus;
+    buttonConfig config{"TEST_BUTTON", {}, {}};
+    CountingButton button{bus, config, io};
+    gpioInfo gpio{"TEST_BUTTON", "TEST_BTN_L", "FALLING"};
+};
+
+} // namespace
+
+TEST_F(EventDispatchTest, EventReachesTheButton)
+{
+    dispatch(true);
+
+    EXPECT_EQ(button.events, 1u);
+    EXPECT_EQ(button.lastEvent.index, 2u);
+    EXPECT_TRUE(button.lastEvent.asserted);
+}
+
+TEST_F(EventDispatchTest, NoAllocationsPerEvent)
+{
+    constexpr size_t eventCount = 10000;
+
+    // Anything set up on the first event is left out
+    dispatch(true);
+    auto allocations = getAllocationCount();
+    for (size_t event = 0; event < eventCount; event++)
+    {
+        dispatch(event % 2 == 0);
+    }
+
+    EXPECT_EQ(getAllocationCount() - allocations, 0u);
+    EXPECT_EQ(button.events, eventCount + 1);
+}
@@ -0,0 +1,352 @@
+#pragma once
+
+#include "gpio_backend.hpp"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+/**
+ * @class FakeGpioBackend
+ *
+ * In-process gpiochips for the gpio code to use instead of libgpiod, from
+ * when it is made until it is destroyed. The lines start high. Setting the
+ * level of a requested line queues an edge on its request, and an eventfd
+ * makes the request readable, so the registry waits and reads as it does
+ * on a BMC. Levels can be set from another thread.
+ *
+ * Debounce periods are turned down, as by a kernel without them, so the
+ * registry debounces in software. Requests of a chip can be made to fail,
+ * to take it out of service.
+ */
+class FakeGpioBackend : public GpioBackend
+{
+  public:
+    FakeGpioBackend()
+    {
+        setGpioBackend(this);
+    }
+
+    ~FakeGpioBackend() override
+    {
+        setGpioBackend(nullptr);
+    }
+
+    FakeGpioBackend(const FakeGpioBackend&) = delete;
+    FakeGpioBackend& operator=(const FakeGpioBackend&) = delete;
+
+    // adds a gpiochip with the given line names, by offset
+    void addChip(const std::string& path, const std::string& label,
+                 const std::vector<std::string>& lineNames)
+    {
+        auto chip = std::make_shared<chipState>();
+        chip->info = gpioChipInfo{path, path.substr(path.rfind('/') + 1),
+                                  label, lineNames.size()};
+        for (const auto& name : lineNames)
+        {
+            chip->lines.push_back(lineState{name, true, 0, nullptr});
+        }
+        chips[path] = chip;
+    }
+
+    // sets the level of a line, which makes an edge if it changes
+    void setLevel(const std::string& path, unsigned int offset, bool high)
+    {
+        auto& chip = *chips.at(path);
+        std::lock_guard lock(chip.mutex);
+        auto& line = chip.lines.at(offset);
+        if (line.high == high)
+        {
+            return;
+        }
+        line.high = high;
+        if (line.request)
+        {
+            line.request->queueEdge(gpioEdge{offset, high, ++line.seqno,
+                                             std::chrono::steady_clock::now()});
+        }
+    }
+
+    // a press and release of a button that is low while pressed, held for
+    // the given time
+    void press(const std::string& path, unsigned int offset,
+               std::chrono::microseconds held)
+    {
+        setLevel(path, offset, false);
+        std::this_thread::sleep_for(held);
+        setLevel(path, offset, true);
+    }
+
+    // makes the next requests of a chip fail
+    void failRequests(const std::string& path, size_t count)
+    {
+        auto& chip = *chips.at(path);
+        std::lock_guard lock(chip.mutex);
+        chip.failedRequests = count;
+    }
+
+    // makes the current requests of a chip fail, as if it had gone away
+    void failChip(const std::string& path)
+    {
+        auto& chip = *chips.at(path);
+        std::lock_guard lock(chip.mutex);
+        for (auto& line : chip.lines)
+        {
+            if (line.request)
+            {
+                line.request->fail();
+            }
+        }
+    }
+
+    std::vector<std::string> listChips() override
+    {
+        std::vector<std::string> paths;
+        for (const auto& [path, chip] : chips)
+        {
+            paths.push_back(path);
+        }
+        return paths;
+    }
+
+    std::unique_ptr<GpioChip> openChip(const std::string& path) override
+    {
+        auto chip = chips.find(path);
+        if (chip == chips.end())
+        {
+            throw std::system_error(ENOENT, std::generic_category(), path);
+        }
+        return std::make_unique<fakeChip>(chip->second);
+    }
+
+  private:
+    class fakeLineRequest;
+
+    struct lineState
+    {
+        std::string name;
+        bool high;
+        unsigned long seqno;     // of the last edge of the request
+        fakeLineRequest* request; // the request that has the line
+    };
+
+    struct chipState
+    {
+        std::mutex mutex;
+        gpioChipInfo info;
+        std::vector<lineState> lines;
+        size_t failedRequests = 0;
+    };
+
+    class fakeLineRequest : public GpioLineRequest
+    {
+      public:
+        fakeLineRequest(std::shared_ptr<chipState> chip,
+                        std::vector<unsigned int> offsets) :
+            chip(std::move(chip)), offsets(std::move(offsets)),
+            eventFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+        {
+            if (eventFd < 0)
+            {
+                throw std::system_error(errno, std::generic_category(),
+                                        "eventfd");
+            }
+        }
+
+        ~fakeLineRequest() override
+        {
+            std::lock_guard lock(chip->mutex);
+            for (auto offset : offsets)
+            {
+                chip->lines[offset].request = nullptr;
+            }
+            close(eventFd);
+        }
+
+        fakeLineRequest(const fakeLineRequest&) = delete;
+        fakeLineRequest& operator=(const fakeLineRequest&) = delete;
+
+        int fd() const override
+        {
+            return eventFd;
+        }
+
+        size_t numLines() const override
+        {
+            return offsets.size();
+        }
+
+        size_t readEdges(std::vector<gpioEdge>& edges) override
+        {
+            std::lock_guard lock(chip->mutex);
+            checkFailed();
+            edges.clear();
+            while (!queue.empty() && edges.size() < maxEdgesPerRead)
+            {
+                edges.push_back(queue.front());
+                queue.pop_front();
+            }
+            if (queue.empty())
+            {
+                uint64_t count;
+                [[maybe_unused]] auto size = read(eventFd, &count,
+                                                  sizeof(count));
+            }
+            return edges.size();
+        }
+
+        bool waitEdges(std::chrono::nanoseconds timeout) override
+        {
+            pollfd pollFd{eventFd, POLLIN, 0};
+            poll(&pollFd, 1,
+                 std::chrono::ceil<std::chrono::milliseconds>(timeout)
+                     .count());
+            std::lock_guard lock(chip->mutex);
+            checkFailed();
+            return !queue.empty();
+        }
+
+        int getValue(unsigned int offset) override
+        {
+            std::lock_guard lock(chip->mutex);
+            checkFailed();
+            return levelOf(offset);
+        }
+
+        std::vector<int>
+            getValues(const std::vector<unsigned int>& lineOffsets) override
+        {
+            std::lock_guard lock(chip->mutex);
+            checkFailed();
+            std::vector<int> values;
+            for (auto offset : lineOffsets)
+            {
+                values.push_back(levelOf(offset));
+            }
+            return values;
+        }
+
+        // these are called with the chip mutex held
+
+        void queueEdge(const gpioEdge& edge)
+        {
+            queue.push_back(edge);
+            wake();
+        }
+
+        void fail()
+        {
+            failed = true;
+            wake();
+        }
+
+      private:
+        void wake()
+        {
+            uint64_t count = 1;
+            [[maybe_unused]] auto size = write(eventFd, &count,
+                                               sizeof(count));
+        }
+
+        void checkFailed() const
+        {
+            if (failed)
+            {
+                throw std::system_error(ENODEV, std::generic_category(),
+                                        chip->info.path);
+            }
+        }
+
+        int levelOf(unsigned int offset) const
+        {
+            if (offset >= chip->lines.size() ||
+                chip->lines[offset].request != this)
+            {
+                throw std::system_error(EINVAL, std::generic_category(),
+                                        "line " + std::to_string(offset) +
+                                            " is not requested");
+            }
+            return chip->lines[offset].high ? 1 : 0;
+        }
+
+        std::shared_ptr<chipState> chip;
+        std::vector<unsigned int> offsets;
+        int eventFd;
+        std::deque<gpioEdge> queue;
+        bool failed = false;
+    };
+
+    class fakeChip : public GpioChip
+    {
+      public:
+        explicit fakeChip(std::shared_ptr<chipState> chip) :
+            chip(std::move(chip))
+        {}
+
+        gpioChipInfo getInfo() override
+        {
+            return chip->info;
+        }
+
+        std::string getLineName(unsigned int offset) override
+        {
+            std::lock_guard lock(chip->mutex);
+            return chip->lines.at(offset).name;
+        }
+
+        std::unique_ptr<GpioLineRequest>
+            requestLines(const std::vector<gpioLineSettings>& lines) override
+        {
+            std::lock_guard lock(chip->mutex);
+            if (chip->failedRequests > 0)
+            {
+                chip->failedRequests--;
+                throw std::system_error(EIO, std::generic_category(),
+                                        chip->info.path);
+            }
+
+            std::vector<unsigned int> offsets;
+            for (const auto& line : lines)
+            {
+                if (line.offset >= chip->lines.size() ||
+                    chip->lines[line.offset].request)
+                {
+                    throw std::system_error(EBUSY, std::generic_category(),
+                                            chip->info.path);
+                }
+                if (line.debounceTime.count() > 0)
+                {
+                    throw std::system_error(EINVAL, std::generic_category(),
+                                            "debounce period");
+                }
+                offsets.push_back(line.offset);
+            }
+
+            auto request = std::make_unique<fakeLineRequest>(chip, offsets);
+            for (auto offset : offsets)
+            {
+                chip->lines[offset].request = request.get();
+                chip->lines[offset].seqno = 0;
+            }
+            return request;
+        }
+
+      private:
+        std::shared_ptr<chipState> chip;
+    };
+
+    std::map<std::string, std::shared_ptr<chipState>> chips;
+};
@@ -0,0 +1,278 @@
+#include "alloc_count.hpp"
+#include "button_factory.hpp"
+#include "gpio.hpp"
+#include "gpio_defs.hpp"
+
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Loads a large generated gpio defs file with the DOM loader the buttons
+// daemon used to have and with the streaming loadGpioDefs(), checks that
+// they give the same button configs, and reports the time, the peak heap
+// and the allocations each takes, and the heap the configs keep. It also
+// reports the heap the daemon keeps once started, with the configs that
+// held a copy of their json entry and with the typed ones.
+//
+// usage: gpio_defs_bench [hosts] [runs]
+
+namespace
+{
+
+// Reads the gpios of a supported gpio defs entry the way the DOM loader
+// did
+void readButtonConfig(const nlohmann::json& gpioConfig,
+                      buttonConfig& buttonCfg)
+{
+    buttonCfg.formFactorName = gpioConfig["name"];
+    if (gpioConfig.contains("group_gpio_config"))
+    {
+        for (const auto& config : gpioConfig["group_gpio_config"])
+        {
+            buttonCfg.gpios.emplace_back(config["name"], config["gpio_name"],
+                                         config["direction"],
+                                         config.value("debounce_ms", 0U));
+        }
+    }
+    else
+    {
+        buttonCfg.gpios.emplace_back(gpioConfig["name"],
+                                     gpioConfig["gpio_name"],
+                                     gpioConfig["direction"],
+                                     gpioConfig.value("debounce_ms", 0U));
+    }
+}
+
+// The loader from before loadGpioDefs(): parse the whole file, then read
+// each supported entry out of the tree
+int loadGpioDefsDom(const std::string& gpioDefsPath,
+                    std::vector<buttonConfig>& buttonConfigs)
+{
+    std::ifstream gpios{gpioDefsPath};
+    auto gpioDefJson = nlohmann::json::parse(gpios, nullptr, true);
+
+    for (const auto& gpioConfig : gpioDefJson["gpio_definitions"])
+    {
+        if (ButtonFactory::instance().isSupported(gpioConfig["name"]))
+        {
+            buttonConfig buttonCfg;
+            readButtonConfig(gpioConfig, buttonCfg);
+            ButtonFactory::instance().parseConfig(buttonCfg.formFactorName,
+                                                  gpioConfig, buttonCfg);
+            buttonConfigs.push_back(std::move(buttonCfg));
+        }
+    }
+    return 0;
+}
+
+// What the daemon kept once started, before its configs were typed: the
+// gpio definitions, and each button's config with a copy of its entry in
+// main's list and again in the button
+struct jsonButtonConfig
+{
+    buttonConfig config;
+    nlohmann::json extraJsonInfo;
+};
+
+struct jsonDaemonState
+{
+    nlohmann::json gpioDefs;
+    std::vector<jsonButtonConfig> allBtnCfgs;
+    std::vector<jsonButtonConfig> buttons;
+};
+
+void startJsonDaemon(const std::string& gpioDefsPath, jsonDaemonState& state)
+{
+    std::ifstream gpios{gpioDefsPath};
+    auto gpioDefJson = nlohmann::json::parse(gpios, nullptr, true);
+    state.gpioDefs = gpioDefJson["gpio_definitions"];
+
+    for (const auto& gpioConfig : state.gpioDefs)
+    {
+        if (ButtonFactory::instance().isSupported(gpioConfig["name"]))
+        {
+            jsonButtonConfig buttonCfg;
+            readButtonConfig(gpioConfig, buttonCfg.config);
+            buttonCfg.extraJsonInfo = gpioConfig;
+            state.allBtnCfgs.push_back(std::move(buttonCfg));
+        }
+    }
+    state.buttons = state.allBtnCfgs;
+}
+
+// What the daemon keeps now: only each button's copy of its typed config,
+// as main frees its list once the buttons are created
+void startTypedDaemon(const std::string& gpioDefsPath,
+                      std::vector<buttonConfig>& buttons)
+{
+    std::vector<buttonConfig> allBtnCfgs;
+    loadGpioDefs(gpioDefsPath, allBtnCfgs);
+    buttons = allBtnCfgs;
+}
+
+// heap the state started by start() keeps
+template <typename State, typename Start>
+size_t measureSteadyState(Start start, const std::string& path)
+{
+    auto heap = getHeapInUse();
+    State state;
+    start(path, state);
+    return getHeapInUse() - heap;
+}
+
+// A multi-host gpio defs file: each host has the four supported button
+// types, and as many entries for gpios other daemons use
+nlohmann::json makeGpioDefs(size_t hosts)
+{
+    using json = nlohmann::json;
+    json definitions = json::array();
+    for (size_t host = 0; host < hosts; host++)
+    {
+        auto suffix = std::to_string(host);
+        definitions.push_back(
+            {{"name", "POWER_BUTTON"},
+             {"gpio_name", "PWR_BTN_L_" + suffix},
+             {"direction", "falling"},
+             {"debounce_ms", 20},
+             {"hold_thresholds",
+              {{{"time_ms", 4000}, {"signal", "Released"}},
+               {{"time_ms", 10000}, {"signal", "PressedLong"}}}}});
+        definitions.push_back({{"name", "RESET_BUTTON"},
+                               {"gpio_name", "RST_BTN_L_" + suffix},
+                               {"direction", "falling"}});
+        definitions.push_back({{"name", "ID_BTN"},
+                               {"gpio_name", "ID_BTN_N_" + suffix},
+                               {"direction", "falling"}});
+
+        json group = json::array();
+        json positions = json::object();
+        for (size_t bit = 0; bit < 4; bit++)
+        {
+            group.push_back(
+                {{"name", "HOST_SELECTOR"},
+                 {"gpio_name", "HS_" + suffix + "_" + std::to_string(bit)},
+                 {"direction", bit % 2 ? "falling" : "rising"}});
+        }
+        for (size_t position = 0; position < 16; position++)
+        {
+            positions[std::to_string(position)] = position % 5;
+        }
+        definitions.push_back({{"name", "HOST_SELECTOR"},
+                               {"group_gpio_config", group},
+                               {"host_selector_map", positions},
+                               {"max_position", 4}});
+
+        for (const auto* other : {"POST_COMPLETE", "NMI_BUTTON",
+                                  "PS_PWROK", "SIO_ONCONTROL"})
+        {
+            definitions.push_back(
+                {{"name", other},
+                 {"gpio_name", std::string(other) + "_" + suffix},
+                 {"direction", "both"},
+                 {"polarity", "active_low"},
+                 {"consumers", {"x86-power-control", "host-error-monitor"}}});
+        }
+    }
+    return {{"gpio_definitions", definitions}};
+}
+
+struct loadResult
+{
+    double bestMs;
+    double meanMs;
+    size_t allocations;
+    size_t peakBytes;     // most heap in use while loading
+    size_t retainedBytes; // heap the loaded configs keep
+    std::vector<buttonConfig> configs;
+};
+
+template <typename Loader>
+loadResult measure(Loader loader, const std::string& path, size_t runs)
+{
+    loadResult result{0, 0, 0, 0, 0, {}};
+    double totalMs = 0;
+    for (size_t run = 0; run < runs; run++)
+    {
+        std::vector<buttonConfig> configs;
+        auto allocations = getAllocationCount();
+        auto heap = getHeapInUse();
+        resetHeapPeak();
+        auto start = std::chrono::steady_clock::now();
+        loader(path, configs);
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        result.allocations = getAllocationCount() - allocations;
+        result.peakBytes = getHeapPeak() - heap;
+        result.retainedBytes = getHeapInUse() - heap;
+
+        totalMs += elapsed.count();
+        if (run == 0 || elapsed.count() < result.bestMs)
+        {
+            result.bestMs = elapsed.count();
+        }
+        result.configs = std::move(configs);
+    }
+    result.meanMs = totalMs / runs;
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t hosts = argc > 1 ? std::stoul(argv[1]) : 256;
+    size_t runs = argc > 2 ? std::stoul(argv[2]) : 5;
+
+    auto path = std::filesystem::temp_directory_path() /
+                ("gpio_defs_bench_" + std::to_string(getpid()) + ".json");
+    {
+        std::ofstream file(path);
+        file << makeGpioDefs(hosts).dump(4);
+    }
+
+    auto dom = measure(loadGpioDefsDom, path, runs);
+    auto sax = measure(loadGpioDefs, path, runs);
+    auto jsonSteady = measureSteadyState<jsonDaemonState>(startJsonDaemon,
+                                                          path);
+    auto typedSteady =
+        measureSteadyState<std::vector<buttonConfig>>(startTypedDaemon, path);
+    auto size = std::filesystem::file_size(path);
+    std::filesystem::remove(path);
+
+    bool same = dom.configs.size() == sax.configs.size();
+    for (size_t index = 0; same && index < dom.configs.size(); index++)
+    {
+        same = isSameButtonConfig(dom.configs[index], sax.configs[index]);
+    }
+
+    std::printf("gpio defs:  %zu hosts, %zu entries, %ju bytes\n", hosts,
+                hosts * 8, static_cast<uintmax_t>(size));
+    std::printf("%-5s %9s %9s %12s %12s %12s %8s\n", "", "best ms",
+                "mean ms", "allocations", "peak bytes", "kept bytes",
+                "buttons");
+    for (const auto& [name, result] : {std::pair{"dom", &dom},
+                                       std::pair{"sax", &sax}})
+    {
+        std::printf("%-5s %9.2f %9.2f %12zu %12zu %12zu %8zu\n", name,
+                    result->bestMs, result->meanMs, result->allocations,
+                    result->peakBytes, result->retainedBytes,
+                    result->configs.size());
+    }
+    std::printf("steady state heap: %zu bytes with json configs, %zu bytes "
+                "with typed configs\n",
+                jsonSteady, typedSteady);
+
+    if (!same)
+    {
+        std::fprintf(stderr, "The loaders gave different button configs\n");
+        return 1;
+    }
+    return 0;
+}
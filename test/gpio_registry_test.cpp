@@ -0,0 +1,299 @@
+#include "fake_gpio_backend.hpp"
+#include "gpio.hpp"
+#include "gpio_registry.hpp"
+
+#include <boost/asio/io_context.hpp>
+
+#include <array>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace std::chrono_literals;
+
+namespace
+{
+
+constexpr auto chipPath = "/dev/gpiochip-test";
+
+std::string lineName(size_t offset)
+{
+    return "TEST_BTN_" + std::to_string(offset);
+}
+
+void recordEvent(void* userdata, const gpioEvent& event)
+{
+    static_cast<std::vector<gpioEvent>*>(userdata)->push_back(event);
+}
+
+class GpioRegistryTest : public ::testing::Test
+{
+  protected:
+    GpioRegistryTest()
+    {
+        gpios.addChip(chipPath, "test-gpio", {lineName(0), lineName(1)});
+        // The registry points at the gpio configs, so they mustn't move
+        // when a test adds a button
+        configs.reserve(events.size());
+    }
+
+    // Adds a button with a gpio on each of the given lines of the chip
+    void addButton(const std::string& direction,
+                   const std::vector<size_t>& offsets,
+                   unsigned int debounceMs = 0)
+    {
+        auto& config = configs.emplace_back();
+        config.formFactorName = "TEST_BUTTON";
+        for (auto offset : offsets)
+        {
+            config.gpios.emplace_back("TEST_BUTTON", lineName(offset),
+                                      direction, debounceMs);
+        }
+    }
+
+    // Requests the gpios of the buttons and binds them to a handler that
+    // records the events of each button
+    void requestAndBind()
+    {
+        ASSERT_EQ(registry.requestGpios(configs), 0);
+        for (size_t button = 0; button < configs.size(); button++)
+        {
+            bindButton(button);
+        }
+    }
+
+    void bindButton(size_t button)
+    {
+        auto& buttonGpios = configs[button].gpios;
+        for (size_t index = 0; index < buttonGpios.size(); index++)
+        {
+            auto& gpio = buttonGpios[index];
+            if (gpio.debounceTime.count() > 0 && !gpio.kernelDebounce)
+            {
+                gpio.debounceTimer =
+                    std::make_shared<boost::asio::steady_timer>(io);
+            }
+            gpio.index = index;
+            gpio.userdata = &events[button];
+            gpio.handler = recordEvent;
+            ASSERT_EQ(registry.bind(gpio), 0);
+        }
+    }
+
+    // Runs the event loop until a button has the given number of events,
+    // or a second has passed
+    void runUntil(size_t button, size_t count)
+    {
+        auto deadline = std::chrono::steady_clock::now() + 1s;
+        while (events[button].size() < count &&
+               std::chrono::steady_clock::now() < deadline)
+        {
+            io.restart();
+            io.run_one_for(10ms);
+        }
+    }
+
+    void runFor(std::chrono::milliseconds time)
+    {
+        io.restart();
+        io.run_for(time);
+    }
+
+    boost::asio::io_context io;
+    FakeGpioBackend gpios;
+    // the gpio configs must outlive the registry, which points at them
+    std::vector<buttonConfig> configs;
+    std::array<std::vector<gpioEvent>, 2> events;
+    GpioRegistry registry{io};
+};
+
+} // namespace
+
+TEST_F(GpioRegistryTest, PressAndReleaseReachTheHandler)
+{
+    addButton("FALLING", {0});
+    requestAndBind();
+
+    auto start = std::chrono::steady_clock::now();
+    gpios.press(chipPath, 0, 1ms);
+    runUntil(0, 2);
+
+    ASSERT_EQ(events[0].size(), 2u);
+    EXPECT_TRUE(events[0][0].asserted);
+    EXPECT_FALSE(events[0][1].asserted);
+    EXPECT_EQ(events[0][0].index, 0u);
+    // The kernel timestamps are on the steady_clock timeline
+    EXPECT_GE(events[0][0].timestamp, start);
+    EXPECT_GE(events[0][1].timestamp - events[0][0].timestamp, 1ms);
+    EXPECT_EQ(configs[0].gpios[0].stats.events, 2u);
+}
+
+TEST_F(GpioRegistryTest, RisingDirectionIsAssertedWhenHigh)
+{
+    addButton("RISING", {0});
+    requestAndBind();
+
+    gpios.press(chipPath, 0, 1ms);
+    runUntil(0, 2);
+
+    ASSERT_EQ(events[0].size(), 2u);
+    EXPECT_FALSE(events[0][0].asserted);
+    EXPECT_TRUE(events[0][1].asserted);
+}
+
+TEST_F(GpioRegistryTest, LinesOnOneChipGoToTheirOwnButtons)
+{
+    addButton("FALLING", {0});
+    addButton("FALLING", {1});
+    requestAndBind();
+
+    const auto& first = configs[0].gpios[0];
+    const auto& second = configs[1].gpios[0];
+    EXPECT_EQ(first.chip, second.chip);
+    EXPECT_NE(first.handle, second.handle);
+    EXPECT_EQ(registry.find(first.handle), &first);
+    EXPECT_EQ(registry.find(second.chip, second.offset), &second);
+
+    gpios.press(chipPath, 1, 1ms);
+    runUntil(1, 2);
+    runFor(20ms);
+
+    EXPECT_TRUE(events[0].empty());
+    EXPECT_EQ(events[1].size(), 2u);
+}
+
+TEST_F(GpioRegistryTest, ReadsTheLineLevels)
+{
+    addButton("FALLING", {0, 1});
+    requestAndBind();
+
+    gpios.setLevel(chipPath, 1, false);
+    runUntil(0, 1);
+
+    EXPECT_EQ(registry.getValue(configs[0].gpios[0]), 1);
+    EXPECT_EQ(registry.getValue(configs[0].gpios[1]), 0);
+    EXPECT_EQ(registry.getValues(configs[0].gpios),
+              (std::vector<int>{1, 0}));
+}
+
+TEST_F(GpioRegistryTest, DebounceDropsABounce)
+{
+    addButton("FALLING", {0}, 50);
+    requestAndBind();
+
+    gpios.press(chipPath, 0, 1ms);
+    runFor(150ms);
+    EXPECT_TRUE(events[0].empty());
+
+    gpios.setLevel(chipPath, 0, false);
+    runUntil(0, 1);
+    ASSERT_EQ(events[0].size(), 1u);
+    EXPECT_TRUE(events[0][0].asserted);
+}
+
+TEST_F(GpioRegistryTest, UnbindStopsTheEvents)
+{
+    addButton("FALLING", {0});
+    requestAndBind();
+
+    auto lineHandle = configs[0].gpios[0].handle;
+    registry.unbind(configs[0].gpios[0]);
+    EXPECT_EQ(registry.find(lineHandle), nullptr);
+
+    gpios.press(chipPath, 0, 1ms);
+    runFor(50ms);
+    EXPECT_TRUE(events[0].empty());
+}
+
+TEST_F(GpioRegistryTest, ReleaseWithEventsQueued)
+{
+    addButton("FALLING", {0});
+    requestAndBind();
+
+    // The request is freed with its fd readable and the wait on it still
+    // queued, which then mustn't touch the freed chip
+    gpios.press(chipPath, 0, 1ms);
+    registry.unbind(configs[0].gpios[0]);
+    runFor(50ms);
+
+    EXPECT_TRUE(events[0].empty());
+    EXPECT_FALSE(registry.isDegraded());
+}
+
+TEST_F(GpioRegistryTest, ReloadKeepsTheBoundLines)
+{
+    addButton("FALLING", {0});
+    requestAndBind();
+    auto lineHandle = configs[0].gpios[0].handle;
+
+    // A button added by a reload gets a copy of its config, as the buttons
+    // do
+    std::vector<buttonConfig> added(1);
+    added[0].formFactorName = "TEST_BUTTON";
+    added[0].gpios.emplace_back("TEST_BUTTON", lineName(1), "FALLING");
+    ASSERT_EQ(registry.reloadGpios(added), 0);
+    configs.push_back(added[0]);
+    bindButton(1);
+
+    EXPECT_EQ(configs[0].gpios[0].handle, lineHandle);
+    EXPECT_EQ(registry.find(lineHandle), &configs[0].gpios[0]);
+
+    gpios.press(chipPath, 0, 1ms);
+    gpios.press(chipPath, 1, 1ms);
+    runUntil(0, 2);
+    runUntil(1, 2);
+    EXPECT_EQ(events[0].size(), 2u);
+    EXPECT_EQ(events[1].size(), 2u);
+}
+
+TEST_F(GpioRegistryTest, FaultedChipComesBackWithTheLineState)
+{
+    addButton("FALLING", {0});
+    requestAndBind();
+
+    gpios.failChip(chipPath);
+    runFor(20ms);
+    EXPECT_TRUE(registry.isDegraded());
+    EXPECT_EQ(configs[0].gpios[0].stats.faults, 1u);
+
+    // The press is missed while the chip is out of service, and passed on
+    // as one edge once it is back
+    gpios.setLevel(chipPath, 0, false);
+    runUntil(0, 1);
+
+    ASSERT_EQ(events[0].size(), 1u);
+    EXPECT_TRUE(events[0][0].asserted);
+    EXPECT_FALSE(registry.isDegraded());
+    EXPECT_EQ(configs[0].gpios[0].stats.recoveries, 1u);
+
+    gpios.setLevel(chipPath, 0, true);
+    runUntil(0, 2);
+    ASSERT_EQ(events[0].size(), 2u);
+    EXPECT_FALSE(events[0][1].asserted);
+}
+
+TEST_F(GpioRegistryTest, FailedRetryBacksOff)
+{
+    addButton("FALLING", {0});
+    requestAndBind();
+
+    // The first retry, after 100 ms, fails too, so the next is 200 ms on.
+    // Each retry tries with kernel debounce and then without it.
+    gpios.failRequests(chipPath, 2);
+    gpios.failChip(chipPath);
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + 2s;
+    runFor(20ms);
+    while (registry.isDegraded() && std::chrono::steady_clock::now() < deadline)
+    {
+        io.restart();
+        io.run_one_for(10ms);
+    }
+
+    EXPECT_FALSE(registry.isDegraded());
+    EXPECT_GE(std::chrono::steady_clock::now() - start, 300ms);
+    EXPECT_EQ(configs[0].gpios[0].stats.faults, 1u);
+    EXPECT_EQ(configs[0].gpios[0].stats.recoveries, 1u);
+}